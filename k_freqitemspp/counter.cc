@@ -0,0 +1,228 @@
+#include "counter.h"
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+ItemCounter::ItemCounter(           // constructor
+    int max_item)                       // max item id of data set
+    : dense_(max_item < MAX_DENSE), max_item_(max_item), mask_(0), 
+    shift_(64)
+{
+    if (dense_) cnt_.resize((u64) max_item+1, 0);
+}
+
+// -----------------------------------------------------------------------------
+ItemCounter::~ItemCounter()         // destructor
+{
+    std::vector<int>().swap(keys_);
+    std::vector<int>().swap(cnt_);
+    std::vector<int>().swap(touched_);
+}
+
+// -----------------------------------------------------------------------------
+void ItemCounter::reserve(          // reserve space for insertions (hash)
+    u64 n_items)                        // expected number of insertions
+{
+    if (dense_) return;
+    
+    // keep the load factor <= 0.5 for the distinct items among n_items, 
+    // which are at most max_item+1; add() grows the table when it is full
+    n_items = std::min(n_items, (u64) max_item_+1);
+    u64 capacity = 16UL;
+    while (capacity < 2*n_items) capacity <<= 1;
+    if (capacity > keys_.size()) rehash(capacity);
+}
+
+// -----------------------------------------------------------------------------
+void ItemCounter::grow()            // double the capacity (hash)
+{
+    rehash(keys_.empty() ? 1024UL : 2*keys_.size());
+}
+
+// -----------------------------------------------------------------------------
+void ItemCounter::rehash(           // re-insert the used slots (hash)
+    u64 capacity)                       // new capacity (power of 2)
+{
+    // the table only grows, so it is reused by the following bins without 
+    // re-allocation
+    int log_cap = 0; while ((1UL << log_cap) < capacity) ++log_cap;
+    
+    std::vector<int> keys(capacity, -1); keys_.swap(keys);
+    std::vector<int> cnt(capacity, 0);   cnt_.swap(cnt);
+    mask_ = (u32) (capacity - 1); shift_ = 64 - log_cap;
+    
+    for (int &x : touched_) {
+        u32 slot = (u32) (((u64) (u32) keys[x] * 0x9E3779B97F4A7C15UL) >> 
+            shift_);
+        while (keys_[slot] >= 0) slot = (slot + 1) & mask_;
+        keys_[slot] = keys[x]; cnt_[slot] = cnt[x]; x = (int) slot;
+    }
+}
+
+// -----------------------------------------------------------------------------
+void ItemCounter::merge(            // add the counters of another counter
+    ItemCounter &other)                 // other counter (cleared on return)
+{
+    // both counters must be of the same kind; for hash counters, the table of
+    // this one grows as needed
+    for (int x : other.touched_) {
+        add(other.dense_ ? x : other.keys_[x], other.cnt_[x]);
+    }
+    other.clear();
+}
+
+// -----------------------------------------------------------------------------
+int ItemCounter::max_freq()         // get the max frequency of all items
+{
+    int max_freq = 0;
+    for (int x : touched_) max_freq = std::max(max_freq, cnt_[x]);
+    
+    return max_freq;
+}
+
+// -----------------------------------------------------------------------------
+int ItemCounter::extract(           // get sorted items with freq >= threshold
+    int threshold,                      // frequency threshold
+    int max_len,                        // max number of items
+    std::vector<int> &items)            // frequent items (return)
+{
+    items.clear();
+    for (int x : touched_) {
+        if (cnt_[x] >= threshold) items.push_back(dense_ ? x : keys_[x]);
+    }
+    // keep the smallest max_len items, as the sort-based counting does
+    if ((int) items.size() > max_len) {
+        std::nth_element(items.begin(), items.begin()+max_len, items.end());
+        items.resize(max_len);
+    }
+    std::sort(items.begin(), items.end());
+    clear();
+    
+    return (int) items.size();
+}
+
+// -----------------------------------------------------------------------------
+void ItemCounter::clear()           // reset all counters of touched items
+{
+    for (int x : touched_) {
+        cnt_[x] = 0;
+        if (!dense_) keys_[x] = -1;
+    }
+    touched_.clear();
+}
+
+// -----------------------------------------------------------------------------
+ClusterItemCounter::ClusterItemCounter() // constructor
+    : size_(0UL), mask_(0), shift_(64)
+{
+}
+
+// -----------------------------------------------------------------------------
+void ClusterItemCounter::grow()     // double the capacity and re-insert
+{
+    u64 capacity = keys_.empty() ? 1024UL : 2*keys_.size();
+    int log_cap  = 0; while ((1UL << log_cap) < capacity) ++log_cap;
+    
+    std::vector<u64> keys(capacity, EMPTY); keys_.swap(keys);
+    std::vector<int> cnt(capacity, 0);      cnt_.swap(cnt);
+    mask_ = (u32) (capacity - 1); shift_ = 64 - log_cap;
+    
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] == EMPTY) continue;
+        u32 slot = (u32) ((keys[i] * 0x9E3779B97F4A7C15UL) >> shift_);
+        while (keys_[slot] != EMPTY) slot = (slot + 1) & mask_;
+        keys_[slot] = keys[i]; cnt_[slot] = cnt[i];
+    }
+}
+
+// -----------------------------------------------------------------------------
+void ClusterItemCounter::group(     // group the counted pairs by cluster
+    int k,                              // number of clusters
+    std::vector<u64> &pos,              // position of each cluster (return)
+    std::vector<int> &items,            // items grouped by cluster (return)
+    std::vector<int> &cnts)             // counts of items (return)
+{
+    // counting sort of the used slots by their labels
+    pos.assign(k+1, 0UL);
+    for (u64 key : keys_) if (key != EMPTY) ++pos[(key >> 32) + 1];
+    for (int i = 1; i <= k; ++i) pos[i] += pos[i-1];
+    
+    items.resize(size_); cnts.resize(size_);
+    std::vector<u64> next(pos.begin(), pos.end()-1);
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        if (keys_[i] == EMPTY) continue;
+        u64 j = next[keys_[i] >> 32]++;
+        items[j] = (int) (u32) keys_[i]; cnts[j] = cnt_[i];
+    }
+    // release the table, as the grouped pairs are all we need
+    std::vector<u64>().swap(keys_);
+    std::vector<int>().swap(cnt_);
+    size_ = 0UL; mask_ = 0; shift_ = 64;
+}
+
+// -----------------------------------------------------------------------------
+HeavyHitters::HeavyHitters(         // constructor
+    int capacity)                       // capacity C
+    : capacity_(capacity), offset_(0UL)
+{
+    cnt_.reserve(2*capacity);
+}
+
+// -----------------------------------------------------------------------------
+void HeavyHitters::reduce()         // keep the largest C counters
+{
+    if ((int) cnt_.size() <= capacity_) return;
+    
+    // subtract the (C+1)-th largest count from all counters (the batched 
+    // Misra-Gries decrement), so at most C counters remain positive
+    std::vector<u64> vals; vals.reserve(cnt_.size());
+    for (const auto &kv : cnt_) vals.push_back(kv.second);
+    std::nth_element(vals.begin(), vals.begin()+capacity_, vals.end(), 
+        std::greater<u64>());
+    u64 d = vals[capacity_];
+    
+    for (auto it = cnt_.begin(); it != cnt_.end(); ) {
+        if (it->second <= d) it = cnt_.erase(it);
+        else { it->second -= d; ++it; }
+    }
+    offset_ += d;
+}
+
+// -----------------------------------------------------------------------------
+void HeavyHitters::merge(           // merge another summary into this one
+    const HeavyHitters &other)          // other summary
+{
+    for (const auto &kv : other.cnt_) cnt_[kv.first] += kv.second;
+    offset_ += other.offset_;
+    reduce();
+}
+
+// -----------------------------------------------------------------------------
+int HeavyHitters::extract(          // get sorted items with freq >= threshold
+    float alpha,                        // threshold = alpha * max_freq
+    int   max_len,                      // max number of items
+    std::vector<int> &items)            // frequent items (return)
+{
+    reduce();
+    
+    // the max count is a lower bound of max_freq, and count + offset is an 
+    // upper bound of the freq of each item, so no item whose freq reaches 
+    // alpha * max_freq is missed once it has a counter
+    u64 max_cnt = 0UL;
+    for (const auto &kv : cnt_) max_cnt = std::max(max_cnt, kv.second);
+    u64 threshold = (u64) ceil((double) max_cnt * alpha);
+    
+    items.clear();
+    for (const auto &kv : cnt_) {
+        if (kv.second + offset_ >= threshold) items.push_back(kv.first);
+    }
+    if ((int) items.size() > max_len) {
+        std::nth_element(items.begin(), items.begin()+max_len, items.end());
+        items.resize(max_len);
+    }
+    std::sort(items.begin(), items.end());
+    
+    return (int) items.size();
+}
+
+} // end namespace clustering
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "def.h"
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+//  ItemCounter: count the (weighted) frequency of items in linear time, by a
+//  dense counter array with a touched list for small dimensionality (e.g., 
+//  u16 data), or by a growing open-addressing hash table for huge 
+//  dimensionality, so its size follows the number of distinct items
+// -----------------------------------------------------------------------------
+class ItemCounter {
+public:
+    ItemCounter(                    // constructor
+        int max_item);                  // max item id of data set
+    
+    // -------------------------------------------------------------------------
+    ~ItemCounter();                 // destructor
+    
+    // -------------------------------------------------------------------------
+    void reserve(                   // reserve space for insertions (hash)
+        u64 n_items);                   // expected number of insertions
+    
+    // -------------------------------------------------------------------------
+    inline void add(                // add the weight of an item
+        int item,                       // item id
+        int w)                          // weight
+    {
+        if (dense_) {
+            if (cnt_[item] == 0) touched_.push_back(item);
+            cnt_[item] += w;
+            return;
+        }
+        // linear probing; touched_ keeps the used slots for a fast reset
+        if (2*(touched_.size()+1) > keys_.size()) grow();
+        u32 slot = (u32) (((u64) (u32) item * 0x9E3779B97F4A7C15UL) >> shift_);
+        while (keys_[slot] != item) {
+            if (keys_[slot] < 0) {
+                keys_[slot] = item; touched_.push_back((int) slot); break;
+            }
+            slot = (slot + 1) & mask_;
+        }
+        cnt_[slot] += w;
+    }
+    
+    // -------------------------------------------------------------------------
+    void merge(                     // add the counters of another counter
+        ItemCounter &other);            // other counter (cleared on return)
+    
+    // -------------------------------------------------------------------------
+    int max_freq();                 // get the max frequency of all items
+    
+    // -------------------------------------------------------------------------
+    int extract(                    // get sorted items with freq >= threshold
+        int threshold,                  // frequency threshold
+        int max_len,                    // max number of items
+        std::vector<int> &items);       // frequent items (return)
+    
+    // -------------------------------------------------------------------------
+    void clear();                   // reset all counters of touched items
+
+protected:
+    bool dense_;                    // use dense counters
+    int  max_item_;                 // max item id of data set
+    u32  mask_;                     // capacity - 1 (hash)
+    int  shift_;                    // 64 - log2(capacity) (hash)
+    std::vector<int> keys_;         // item of each slot, -1: empty (hash)
+    std::vector<int> cnt_;          // counter of each item (dense) or slot
+    std::vector<int> touched_;      // touched items (dense) or slots (hash)
+    
+    // -------------------------------------------------------------------------
+    void rehash(                    // re-insert the used slots (hash)
+        u64 capacity);                  // new capacity (power of 2)
+    
+    // -------------------------------------------------------------------------
+    void grow();                    // double the capacity (hash)
+};
+
+// -----------------------------------------------------------------------------
+//  ClusterItemCounter: count the (weighted) frequency of (cluster, item) pairs
+//  by a growing open-addressing hash table, so a single pass over the data can
+//  count the items of all clusters at once
+// -----------------------------------------------------------------------------
+class ClusterItemCounter {
+public:
+    ClusterItemCounter();           // constructor
+    
+    // -------------------------------------------------------------------------
+    inline void add(                // add the weight of an item of a cluster
+        int label,                      // cluster label
+        int item,                       // item id
+        int w)                          // weight
+    {
+        if (2*(size_+1) > keys_.size()) grow();
+        
+        u64 key  = ((u64) (u32) label << 32) | (u32) item;
+        u32 slot = (u32) ((key * 0x9E3779B97F4A7C15UL) >> shift_);
+        while (keys_[slot] != key) {
+            if (keys_[slot] == EMPTY) { keys_[slot] = key; ++size_; break; }
+            slot = (slot + 1) & mask_;
+        }
+        cnt_[slot] += w;
+    }
+    
+    // -------------------------------------------------------------------------
+    void group(                     // group the counted pairs by cluster
+        int k,                          // number of clusters
+        std::vector<u64> &pos,          // position of each cluster (return)
+        std::vector<int> &items,        // items grouped by cluster (return)
+        std::vector<int> &cnts);        // counts of items (return)
+
+protected:
+    static const u64 EMPTY = ~0UL;  // key of an empty slot
+    u64  size_;                     // number of used slots
+    u32  mask_;                     // capacity - 1
+    int  shift_;                    // 64 - log2(capacity)
+    std::vector<u64> keys_;         // (label, item) key of each slot
+    std::vector<int> cnt_;          // counter of each slot
+    
+    // -------------------------------------------------------------------------
+    void grow();                    // double the capacity and re-insert
+};
+
+// -----------------------------------------------------------------------------
+//  HeavyHitters: a mergeable Misra-Gries summary with at most 2C counters. A 
+//  counter under-counts its item by at most offset() <= W/(C+1), where W is 
+//  the total weight added, and an item without counter has freq <= offset()
+// -----------------------------------------------------------------------------
+class HeavyHitters {
+public:
+    HeavyHitters(                   // constructor
+        int capacity);                  // capacity C
+    
+    // -------------------------------------------------------------------------
+    inline void add(                // add the weight of an item
+        int item,                       // item id
+        int w)                          // weight
+    {
+        cnt_[item] += (u64) w;
+        if ((int) cnt_.size() >= 2*capacity_) reduce();
+    }
+    
+    // -------------------------------------------------------------------------
+    void merge(                     // merge another summary into this one
+        const HeavyHitters &other);     // other summary
+    
+    // -------------------------------------------------------------------------
+    int extract(                    // get sorted items with freq >= threshold
+        float alpha,                    // threshold = alpha * max_freq
+        int   max_len,                  // max number of items
+        std::vector<int> &items);       // frequent items (return)
+    
+    // -------------------------------------------------------------------------
+    u64 offset() const { return offset_; } // max under-count of an item
+    
+    // -------------------------------------------------------------------------
+    void swap(                      // swap with another summary
+        HeavyHitters &other)            // other summary
+    {
+        std::swap(capacity_, other.capacity_);
+        std::swap(offset_, other.offset_);
+        cnt_.swap(other.cnt_);
+    }
+
+protected:
+    int capacity_;                  // capacity C
+    u64 offset_;                    // total decrement of all counters
+    std::unordered_map<int,u64> cnt_; // counters
+    
+    // -------------------------------------------------------------------------
+    void reduce();                  // keep the largest C counters
+};
+
+} // end namespace clustering
@@ -35,5 +35,16 @@ const int MIN_INT      = -MAX_INT;
 
 const int RANDOM_SEED  = 666;         // random seed
 const int MAX_ITER     = 10;          // maximum iteration
+const int GALLOP_RATIO = 32;          // length ratio to use galloping search
+const int SMALL_LEN    = 16;          // max length of the unrolled search
+const int SMALL_RATIO  = 4;           // length ratio to use unrolled search
+const int MAX_BITMAP   = 65536;       // max #bits of a seed bitmap (8 KB)
+const int LSH_AUDIT    = 1000;        // number of sampled data to audit lsh
+const int OVERSAMPLE   = 2;           // oversampling factor l/k of k-means||
+const int SCAN_BLOCK   = 4096;        // block size of the blocked prefix sum
+const int MAX_DENSE    = 1 << 22;     // max dimension to use dense counters
+const int STREAM_SAMPLE = 20;         // sample size / k of out-of-core seeding
+const int PACK_BLOCK   = 64;          // rows per block of packed row offsets
+const int PACK_PAD     = 16;          // zero bytes after packed rows (simd)
 
 } // end namespace clustering
@@ -0,0 +1,308 @@
+#include "intersect.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+namespace clustering {
+
+#ifdef SIMD_X86
+// -----------------------------------------------------------------------------
+//  block-compare kernels: load a block of W items from each set (u16 items
+//  are zero-extended to int32 lanes), compare all W*W pairs by rotations of
+//  the block of b, then advance the block(s) with the smaller last item. The
+//  rotations are independent in-lane shuffles (and lane swaps), not a chain
+//  of permutes; the tail is compared by the narrower blocks first, and then
+//  merged by the scalar kernel.
+// -----------------------------------------------------------------------------
+__attribute__((target("sse4.2")))
+static inline __m128i load_x4(const int *p)
+{
+    return _mm_loadu_si128((const __m128i*) p);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("sse4.2")))
+static inline __m128i load_x4(const u16 *p)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) p));
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+__attribute__((target("sse4.2")))
+static inline int sse_blocks(       // 4x4 blocks of SSE4.2 from (i, j)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b,                        // set b
+    int   &i,                           // position in a (return)
+    int   &j)                           // position in b (return)
+{
+    int overlap = 0;
+    while (i+4 <= n_a && j+4 <= n_b) {
+        __m128i va = load_x4(a+i);
+        __m128i vb = load_x4(b+j);
+        
+        __m128i m0 = _mm_cmpeq_epi32(va, vb);
+        __m128i m1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39));
+        __m128i m2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4E));
+        __m128i m3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93));
+        __m128i m  = _mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3));
+        overlap += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+        
+        int a_max = a[i+3], b_max = b[j+3];
+        if (a_max <= b_max) i += 4;
+        if (b_max <= a_max) j += 4;
+    }
+    return overlap;
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+__attribute__((target("sse4.2")))
+static int sse_intersect(           // SSE4.2 intersection (4x4 block)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    int i = 0, j = 0;
+    int overlap = sse_blocks<T1,T2>(n_a, n_b, a, b, i, j);
+    
+    return overlap + scalar_intersect<T1,T2>(n_a-i, n_b-j, a+i, b+j);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("sse4.2")))
+static int sse_intersect_u16(       // SSE4.2 intersection by pcmpestrm (8x8)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const u16 *a,                       // set a
+    const u16 *b)                       // set b
+{
+    const int mode = _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+    
+    int overlap = 0, i = 0, j = 0;
+    while (i+8 <= n_a && j+8 <= n_b) {
+        __m128i va = _mm_loadu_si128((const __m128i*) (a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i*) (b+j));
+        
+        __m128i m = _mm_cmpestrm(vb, 8, va, 8, mode);
+        overlap += __builtin_popcount(_mm_cvtsi128_si32(m));
+        
+        u16 a_max = a[i+7], b_max = b[j+7];
+        if (a_max <= b_max) i += 8;
+        if (b_max <= a_max) j += 8;
+    }
+    return overlap + scalar_intersect<u16,u16>(n_a-i, n_b-j, a+i, b+j);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static inline __m256i load_x8(const int *p)
+{
+    return _mm256_loadu_si256((const __m256i*) p);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static inline __m256i load_x8(const u16 *p)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p));
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+__attribute__((target("avx2")))
+static inline int avx2_blocks(      // 8x8 blocks of AVX2 from (i, j)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b,                        // set b
+    int   &i,                           // position in a (return)
+    int   &j)                           // position in b (return)
+{
+    int overlap = 0;
+    while (i+8 <= n_a && j+8 <= n_b) {
+        __m256i va = load_x8(a+i);
+        __m256i vb = load_x8(b+j);
+        __m256i vs = _mm256_permute2x128_si256(vb, vb, 0x01); // swap halves
+        
+        __m256i m0 = _mm256_or_si256(_mm256_cmpeq_epi32(va, vb), 
+            _mm256_cmpeq_epi32(va, vs));
+        __m256i m1 = _mm256_or_si256(
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x39)), 
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x39)));
+        __m256i m2 = _mm256_or_si256(
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x4E)), 
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x4E)));
+        __m256i m3 = _mm256_or_si256(
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vb, 0x93)), 
+            _mm256_cmpeq_epi32(va, _mm256_shuffle_epi32(vs, 0x93)));
+        __m256i m  = _mm256_or_si256(_mm256_or_si256(m0, m1), 
+            _mm256_or_si256(m2, m3));
+        overlap += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+        
+        int a_max = a[i+7], b_max = b[j+7];
+        if (a_max <= b_max) i += 8;
+        if (b_max <= a_max) j += 8;
+    }
+    return overlap;
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+__attribute__((target("avx2")))
+static int avx2_intersect(          // AVX2 intersection (8x8 block)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    int i = 0, j = 0;
+    int overlap = avx2_blocks<T1,T2>(n_a, n_b, a, b, i, j);
+    overlap += sse_blocks<T1,T2>(n_a, n_b, a, b, i, j);
+    
+    return overlap + scalar_intersect<T1,T2>(n_a-i, n_b-j, a+i, b+j);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("avx512f")))
+static inline __m512i load_x16(const int *p)
+{
+    return _mm512_loadu_si512((const void*) p);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("avx512f")))
+static inline __m512i load_x16(const u16 *p)
+{
+    return _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) p));
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+__attribute__((target("avx512f")))
+static int avx512_intersect(        // AVX-512 intersection (16x16 block)
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    int overlap = 0, i = 0, j = 0;
+    while (i+16 <= n_a && j+16 <= n_b) {
+        __m512i va = load_x16(a+i);
+        __m512i vb[4];
+        vb[0] = load_x16(b+j);
+        vb[1] = _mm512_shuffle_i32x4(vb[0], vb[0], 0x39); // rotate by 4
+        vb[2] = _mm512_shuffle_i32x4(vb[0], vb[0], 0x4E); // rotate by 8
+        vb[3] = _mm512_shuffle_i32x4(vb[0], vb[0], 0x93); // rotate by 12
+        
+        __mmask16 m = 0;
+        for (int r = 0; r < 4; ++r) {
+            m |= _mm512_cmpeq_epi32_mask(va, vb[r]);
+            m |= _mm512_cmpeq_epi32_mask(va, 
+                _mm512_shuffle_epi32(vb[r], (_MM_PERM_ENUM) 0x39));
+            m |= _mm512_cmpeq_epi32_mask(va, 
+                _mm512_shuffle_epi32(vb[r], (_MM_PERM_ENUM) 0x4E));
+            m |= _mm512_cmpeq_epi32_mask(va, 
+                _mm512_shuffle_epi32(vb[r], (_MM_PERM_ENUM) 0x93));
+        }
+        overlap += __builtin_popcount((unsigned int) m);
+        
+        int a_max = a[i+15], b_max = b[j+15];
+        if (a_max <= b_max) i += 16;
+        if (b_max <= a_max) j += 16;
+    }
+    overlap += avx2_blocks<T1,T2>(n_a, n_b, a, b, i, j);
+    overlap += sse_blocks<T1,T2>(n_a, n_b, a, b, i, j);
+    
+    return overlap + scalar_intersect<T1,T2>(n_a-i, n_b-j, a+i, b+j);
+}
+#endif
+
+// -----------------------------------------------------------------------------
+static int support_simd()           // highest supported instruction set
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 3;
+    if (__builtin_cpu_supports("avx2"))    return 2;
+    if (__builtin_cpu_supports("sse4.2"))  return 1;
+#endif
+    return 0;
+}
+
+static const int g_support = support_simd(); // supported instruction set
+
+// -----------------------------------------------------------------------------
+static int select_simd()            // select instruction set (0: scalar,
+                                    // 1: sse4.2, 2: avx2, 3: avx512)
+{
+    // levels are ranked by kpp_isect: avx512 is at most on par with avx2 on
+    // News20-like rows and slower on Criteo-like rows (39 items, so a 16x16
+    // block rarely fits twice), thus avx2 is preferred when it is supported
+    return std::min(g_support, 2);
+}
+
+static const int g_simd = select_simd(); // selected instruction set
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+static int (*select_intersect(      // block kernel of an instruction set
+    int   level))(int, int, const T1*, const T2*) // instruction set
+{
+#ifdef SIMD_X86
+    switch (level) {
+    case 3:  return avx512_intersect<T1,T2>;
+    case 2:  return avx2_intersect<T1,T2>;
+    case 1:  return sse_intersect<T1,T2>;
+    default: break;
+    }
+#endif
+    return scalar_intersect<T1,T2>;
+}
+
+// -----------------------------------------------------------------------------
+isect_int_int_func intersect_kernel_int(// kernel for int data & int seed
+    int   level)                        // instruction set
+{
+    return select_intersect<int,int>(level);
+}
+
+// -----------------------------------------------------------------------------
+isect_u16_u16_func intersect_kernel_u16(// kernel for u16 data & u16 seed
+    int   level)                        // instruction set
+{
+#ifdef SIMD_X86
+    if (level == 1) return sse_intersect_u16;
+#endif
+    return select_intersect<u16,u16>(level);
+}
+
+isect_int_int_func g_isect_int_int = intersect_kernel_int(g_simd);
+isect_u16_u16_func g_isect_u16_u16 = intersect_kernel_u16(g_simd);
+
+// -----------------------------------------------------------------------------
+int simd_level()                    // level of the selected instruction set
+{
+    return g_simd;
+}
+
+// -----------------------------------------------------------------------------
+int simd_support()                  // highest supported instruction set
+{
+    return g_support;
+}
+
+// -----------------------------------------------------------------------------
+const char* simd_name(              // name of an instruction set
+    int   level)                        // instruction set
+{
+    static const char *names[] = { "scalar", "sse4.2", "avx2", "avx512" };
+    return names[level];
+}
+
+} // end namespace clustering
\ No newline at end of file
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "def.h"
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+//  intersection-count kernels for two sorted sets (runtime CPU dispatch)
+// -----------------------------------------------------------------------------
+typedef int (*isect_int_int_func)(int, int, const int*, const int*);
+typedef int (*isect_u16_u16_func)(int, int, const u16*, const u16*);
+
+extern isect_int_int_func g_isect_int_int; // kernel for int data & int seed
+extern isect_u16_u16_func g_isect_u16_u16; // kernel for u16 data & u16 seed
+
+// -----------------------------------------------------------------------------
+//  instruction sets: 0: scalar, 1: sse4.2, 2: avx2, 3: avx512; the kernels of
+//  any level up to simd_support() can be called, e.g., by kpp_isect
+// -----------------------------------------------------------------------------
+int simd_level();                   // level of the selected instruction set
+
+// -----------------------------------------------------------------------------
+int simd_support();                 // highest supported instruction set
+
+// -----------------------------------------------------------------------------
+const char* simd_name(              // name of an instruction set
+    int   level = simd_level());        // instruction set
+
+// -----------------------------------------------------------------------------
+isect_int_int_func intersect_kernel_int(// kernel for int data & int seed
+    int   level);                       // instruction set
+
+// -----------------------------------------------------------------------------
+isect_u16_u16_func intersect_kernel_u16(// kernel for u16 data & u16 seed
+    int   level);                       // instruction set
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+int scalar_intersect(               // branchless merge of two sorted sets
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    int overlap = 0, i = 0, j = 0; // i for a, j for b
+    while (i < n_a && j < n_b) {
+        int x = (int) a[i], y = (int) b[j];
+        overlap += (x == y); i += (x <= y); j += (y <= x);
+    }
+    return overlap;
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+const T2* branchless_lower_bound(   // branchless lower bound of x in b
+    int   n_b,                          // length of set b (n_b > 0)
+    const T2 *b,                        // set b
+    T1    x)                            // target item
+{
+    const T2 *base = b;
+    while (n_b > 1) {
+        int half = n_b >> 1;
+        base = ((int) base[half] < (int) x) ? base + half : base;
+        n_b -= half;
+    }
+    return base + ((int) *base < (int) x);
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+int gallop_intersect(               // galloping intersection (n_a << n_b)
+    int   n_a,                          // length of set a (shorter)
+    int   n_b,                          // length of set b (longer)
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    int overlap = 0, j = 0;
+    for (int i = 0; i < n_a && j < n_b; ++i) {
+        int x = (int) a[i];
+        
+        // exponential search for the range of x, then binary search in it
+        int step = 1, hi = j;
+        while (hi < n_b && (int) b[hi] < x) { j = hi + 1; hi += step; step <<= 1; }
+        if (hi > n_b) hi = n_b;
+        if (hi > j) j = branchless_lower_bound<T1,T2>(hi-j, b+j, a[i]) - b;
+        
+        if (j < n_b && (int) b[j] == x) { ++overlap; ++j; }
+    }
+    return overlap;
+}
+
+// -----------------------------------------------------------------------------
+template<int N, class T1, class T2>
+int small_intersect(                // intersection for a fixed small n_a = N
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a (length N)
+    const T2 *b)                        // set b
+{
+    // the loop over N items is unrolled at compile time, and each item is
+    // searched in the rest of b by a branchless binary search
+    int overlap = 0;
+    const T2 *end = b + n_b;
+    for (int i = 0; i < N; ++i) {
+        if (b == end) break;
+        b = branchless_lower_bound<T1,T2>(end-b, b, a[i]);
+        int hit = (b != end && (int) *b == (int) a[i]);
+        overlap += hit; b += hit;
+    }
+    return overlap;
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+int skewed_intersect(               // intersection for skewed lengths
+    int   n_a,                          // length of set a (shorter)
+    int   n_b,                          // length of set b (longer)
+    const T1 *a,                        // set a
+    const T2 *b)                        // set b
+{
+    switch (n_a) {
+    case 1:  return small_intersect<1, T1,T2>(n_b, a, b);
+    case 2:  return small_intersect<2, T1,T2>(n_b, a, b);
+    case 3:  return small_intersect<3, T1,T2>(n_b, a, b);
+    case 4:  return small_intersect<4, T1,T2>(n_b, a, b);
+    case 5:  return small_intersect<5, T1,T2>(n_b, a, b);
+    case 6:  return small_intersect<6, T1,T2>(n_b, a, b);
+    case 7:  return small_intersect<7, T1,T2>(n_b, a, b);
+    case 8:  return small_intersect<8, T1,T2>(n_b, a, b);
+    case 9:  return small_intersect<9, T1,T2>(n_b, a, b);
+    case 10: return small_intersect<10,T1,T2>(n_b, a, b);
+    case 11: return small_intersect<11,T1,T2>(n_b, a, b);
+    case 12: return small_intersect<12,T1,T2>(n_b, a, b);
+    case 13: return small_intersect<13,T1,T2>(n_b, a, b);
+    case 14: return small_intersect<14,T1,T2>(n_b, a, b);
+    case 15: return small_intersect<15,T1,T2>(n_b, a, b);
+    case 16: return small_intersect<16,T1,T2>(n_b, a, b);
+    default: return gallop_intersect<T1,T2>(n_a, n_b, a, b);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class T1, class T2>
+int adaptive_intersect(             // choose intersection by length ratio
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const T1 *a,                        // set a
+    const T2 *b,                        // set b
+    int   (*kernel)(int, int, const T1*, const T2*)) // block/merge kernel
+{
+    if (n_a == 0 || n_b == 0) return 0;
+    
+    // search the shorter set in the longer one for skewed pairs (unrolled for
+    // short sets, galloping otherwise), and use the SIMD block (or branchless
+    // merge) kernel for similar lengths
+    if (n_a <= n_b) {
+        int ratio = n_a <= SMALL_LEN ? SMALL_RATIO : GALLOP_RATIO;
+        if ((u64) n_a * ratio <= (u64) n_b) {
+            return skewed_intersect<T1,T2>(n_a, n_b, a, b);
+        }
+    }
+    else {
+        int ratio = n_b <= SMALL_LEN ? SMALL_RATIO : GALLOP_RATIO;
+        if ((u64) n_b * ratio <= (u64) n_a) {
+            return skewed_intersect<T2,T1>(n_b, n_a, b, a);
+        }
+    }
+    return kernel(n_a, n_b, a, b);
+}
+
+// -----------------------------------------------------------------------------
+inline int intersect_count(         // count the overlap of two sorted sets
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const int *a,                       // set a
+    const int *b)                       // set b
+{
+    return adaptive_intersect<int,int>(n_a, n_b, a, b, g_isect_int_int);
+}
+
+// -----------------------------------------------------------------------------
+inline int intersect_count(         // count the overlap of two sorted sets
+    int   n_a,                          // length of set a
+    int   n_b,                          // length of set b
+    const u16 *a,                       // set a
+    const u16 *b)                       // set b
+{
+    return adaptive_intersect<u16,u16>(n_a, n_b, a, b, g_isect_u16_u16);
+}
+
+} // end namespace clustering
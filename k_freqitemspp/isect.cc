@@ -0,0 +1,253 @@
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "util.h"
+
+using namespace clustering;
+
+// -----------------------------------------------------------------------------
+//  Rand: a small counter-based generator, so the sets do not depend on rand()
+// -----------------------------------------------------------------------------
+struct Rand {
+    u64   state_;                   // counter
+    
+    Rand(u64 seed) : state_(seed) {}
+    
+    u64 next() { return mix64(state_++ * 0x9E3779B97F4A7C15UL); }
+    
+    int below(int n) { return (int) (next() % (u64) n); } // in [0,n)
+    
+    double real() { return (double) (next() >> 11) * (1.0/9007199254740992.0); }
+};
+
+// -----------------------------------------------------------------------------
+//  Rows: sorted sets in the same layout as the data sets (items & positions)
+// -----------------------------------------------------------------------------
+template<class DType>
+struct Rows {
+    std::vector<DType> items_;      // items of all rows
+    std::vector<u64>   pos_;        // start position of each row
+    
+    Rows() : pos_(1, 0UL) {}
+    
+    void add(std::vector<int> &row) { // add a row (sorted & deduplicated)
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+        items_.insert(items_.end(), row.begin(), row.end());
+        pos_.push_back(items_.size());
+    }
+    int size() const { return (int) pos_.size() - 1; }
+    int length(int i) const { return get_length(i, pos_.data()); }
+    const DType* row(int i) const { return items_.data() + pos_[i]; }
+};
+
+// -----------------------------------------------------------------------------
+void usage()                        // display the usage
+{
+    printf("\n"
+        "--------------------------------------------------------------------\n"
+        " Parameters of kpp_isect (test & benchmark of intersection kernels) \n"
+        "--------------------------------------------------------------------\n"
+        " -t  {integer}  number of random pairs to test per kernel\n"
+        " -b  {integer}  number of pairs to benchmark per kernel (0: none)\n"
+        " -s  {integer}  random seed\n"
+        "\n\n\n");
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void gen_test_pair(                 // gen a pair of sets sharing some items
+    Rand  &rnd,                         // random generator
+    Rows<DType> &rows)                  // two rows (return)
+{
+    // mostly short sets around the block widths (4, 8, 16) and their tails,
+    // sometimes long or skewed ones; the universe is placed at the top of the
+    // range of DType at times, so that u16 items >= 32768 are covered
+    int max_len = rnd.below(8) == 0 ? 1024 : 48;
+    int n_a = rnd.below(max_len+1), n_b = rnd.below(max_len+1);
+    int range = (sizeof(DType) == 2) ? 65536 : MAX_INT;
+    int univ = std::min(range, 2*(n_a+n_b) + 1 + rnd.below(4*(n_a+n_b)+1));
+    int base = 0;
+    switch (rnd.below(3)) {
+    case 0:  base = 0; break;
+    case 1:  base = range - univ; break;
+    default: base = rnd.below(range - univ + 1); break;
+    }
+    
+    std::vector<int> a, b;
+    for (int i = 0; i < n_a; ++i) a.push_back(base + rnd.below(univ));
+    for (int i = 0; i < n_b; ++i) {
+        // copy an item of a at times to get a non-trivial overlap
+        bool copy = !a.empty() && rnd.below(2);
+        b.push_back(copy ? a[rnd.below((int) a.size())] : 
+            base + rnd.below(univ));
+    }
+    rows.add(a); rows.add(b);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType, class Kernels>
+int test_kernels(                   // test kernels against the scalar merge
+    int   n_pairs,                      // number of random pairs
+    u64   seed,                         // random seed
+    const char *type,                   // name of DType
+    Kernels kernel_of)                  // kernel of each instruction set
+{
+    Rand rnd(seed);
+    Rows<DType> rows;
+    for (int i = 0; i < n_pairs; ++i) gen_test_pair<DType>(rnd, rows);
+    
+    int n_errors = 0;
+    for (int level = 0; level <= simd_support(); ++level) {
+        auto kernel = kernel_of(level);
+        int n_wrong = 0;
+        for (int i = 0; i < rows.size(); i += 2) {
+            int n_a = rows.length(i), n_b = rows.length(i+1);
+            const DType *a = rows.row(i), *b = rows.row(i+1);
+            int truth = scalar_intersect<DType,DType>(n_a, n_b, a, b);
+            
+            // the block kernel in both orders, and the adaptive dispatch
+            // (galloping & unrolled search for skewed pairs) on top of it
+            int ab = kernel(n_a, n_b, a, b), ba = kernel(n_b, n_a, b, a);
+            int ad_ab = adaptive_intersect<DType,DType>(n_a, n_b, a, b, kernel);
+            int ad_ba = adaptive_intersect<DType,DType>(n_b, n_a, b, a, kernel);
+            if (ab != truth || ba != truth || ad_ab != truth || 
+                ad_ba != truth) {
+                if (n_wrong++ == 0) {
+                    printf("  mismatch: n_a=%d, n_b=%d, overlap=%d (%d %d %d "
+                        "%d)\n", n_a, n_b, truth, ab, ba, ad_ab, ad_ba);
+                }
+            }
+        }
+        printf("%-6s %-6s: %d pairs, %d mismatches\n", type, simd_name(level), 
+            n_pairs, n_wrong);
+        n_errors += n_wrong;
+    }
+    return n_errors;
+}
+
+// -----------------------------------------------------------------------------
+void gen_news20(                    // gen News20-like rows (d=6.2e4, avg 80)
+    int   n,                            // number of rows
+    Rand  &rnd,                         // random generator
+    Rows<u16> &rows)                    // rows (return)
+{
+    // long-tailed lengths and skewed word ids (small ids are frequent)
+    std::vector<int> row;
+    for (int i = 0; i < n; ++i) {
+        int len = std::min(2000, 8 + (int) (-72.0 * log(1.0 - rnd.real())));
+        row.clear();
+        for (int j = 0; j < len; ++j) {
+            double r = rnd.real();
+            row.push_back((int) (62000 * r * r));
+        }
+        rows.add(row);
+    }
+}
+
+// -----------------------------------------------------------------------------
+void gen_criteo(                    // gen Criteo-like rows (d=1e6, 39 fields)
+    int   n,                            // number of rows
+    Rand  &rnd,                         // random generator
+    Rows<int> &rows)                    // rows (return)
+{
+    // one item per field, skewed to the frequent values of each field
+    const int n_fields = 39, field_size = 1000000 / n_fields;
+    std::vector<int> row;
+    for (int i = 0; i < n; ++i) {
+        row.clear();
+        for (int f = 0; f < n_fields; ++f) {
+            double r = rnd.real();
+            row.push_back(f*field_size + (int) (field_size * r * r * r));
+        }
+        rows.add(row);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType, class Kernels>
+void bench_kernels(                 // report intersections/sec of kernels
+    int   n_pairs,                      // number of pairs
+    const char *name,                   // name of distribution
+    const Rows<DType> &rows,            // rows
+    Kernels kernel_of)                  // kernel of each instruction set
+{
+    int n = rows.size();
+    for (int level = 0; level <= simd_support(); ++level) {
+        auto kernel = kernel_of(level);
+        for (int adaptive = 0; adaptive <= 1; ++adaptive) {
+            u64 overlap = 0UL;
+            double start_time = omp_get_wtime();
+            for (int p = 0; p < n_pairs; ++p) {
+                int i = p % n, j = (int) (mix64(p) % (u64) n);
+                int n_a = rows.length(i), n_b = rows.length(j);
+                const DType *a = rows.row(i), *b = rows.row(j);
+                overlap += adaptive ? adaptive_intersect<DType,DType>(n_a, n_b, 
+                    a, b, kernel) : kernel(n_a, n_b, a, b);
+            }
+            double time = omp_get_wtime() - start_time;
+            printf("%-8s %-6s %-8s: %.2f M intersections/sec (overlap=%lu)\n", 
+                name, simd_name(level), adaptive ? "adaptive" : "block", 
+                n_pairs / time / 1e6, overlap);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+int main(int nargs, char **args)
+{
+    int   n_test  = 200000;         // number of random pairs to test
+    int   n_bench = 2000000;        // number of pairs to benchmark
+    int   seed    = 6;              // random seed
+    
+    int cnt = 1;
+    while (cnt < nargs) {
+        if (strcmp(args[cnt], "-t") == 0) {
+            n_test = atoi(args[++cnt]); assert(n_test >= 0);
+            printf("n_test=%d\n", n_test);
+        }
+        else if (strcmp(args[cnt], "-b") == 0) {
+            n_bench = atoi(args[++cnt]); assert(n_bench >= 0);
+            printf("n_bench=%d\n", n_bench);
+        }
+        else if (strcmp(args[cnt], "-s") == 0) {
+            seed = atoi(args[++cnt]);
+            printf("seed=%d\n", seed);
+        }
+        else {
+            printf("Parameters error!\n"); usage(); exit(1);
+        }
+        ++cnt;
+    }
+    printf("SIMD = %s\n\n", simd_name());
+    
+    // -------------------------------------------------------------------------
+    //  correctness of every supported kernel against the scalar merge
+    // -------------------------------------------------------------------------
+    int n_errors = 0;
+    n_errors += test_kernels<u16>(n_test, seed, "uint16", intersect_kernel_u16);
+    n_errors += test_kernels<int>(n_test, seed, "int32",  intersect_kernel_int);
+    printf("\n");
+    if (n_errors > 0) { printf("FAILED: %d mismatches\n", n_errors); return 1; }
+    
+    // -------------------------------------------------------------------------
+    //  intersections/sec on News20-like (uint16) & Criteo-like (int32) rows
+    // -------------------------------------------------------------------------
+    if (n_bench > 0) {
+        Rand rnd(seed);
+        Rows<u16> news20; gen_news20(20000, rnd, news20);
+        Rows<int> criteo; gen_criteo(100000, rnd, criteo);
+        
+        bench_kernels<u16>(n_bench, "News20", news20, intersect_kernel_u16);
+        bench_kernels<int>(n_bench, "Criteo", criteo, intersect_kernel_int);
+        printf("\n");
+    }
+    printf("PASSED\n");
+    return 0;
+}
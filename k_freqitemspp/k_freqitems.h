@@ -7,17 +7,21 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <numeric>
 #include <vector>
 #include <string>
 
 #include "def.h"
 #include "util.h"
 #include "seeding.h"
+#include "packed.h"
 
 namespace clustering {
 
 // -----------------------------------------------------------------------------
-//  KFreqItems: k-freqitems clustering for sparse data over Jaccard distance
+//  KFreqItems: k-freqitems clustering for sparse data over Jaccard distance; 
+//  the rows may be packed, for which only the k-means++ seeding and the 
+//  exact & fused assignments are supported
 // -----------------------------------------------------------------------------
 template<class DType>
 class KFreqItems {
@@ -25,10 +29,21 @@ public:
     KFreqItems(                     // constructor
         int   n,                        // number of data points
         int   max_iter,                 // maximum iteration
+        float change_ratio,             // stop if changed labels <= ratio * n
+        float mse_tol,                  // stop if mse delta <= tol*mse (0: off)
+        int   seed_type,                // seeding (0: k-means++, 1: k-means||)
+        int   n_rounds,                 // number of k-means|| rounds (0: auto)
+        int   assign_type,              // assignment type (0-6)
+        int   bitmap_len,               // min seed length for bitmap (0: none)
+        int   n_bands,                  // number of lsh bands
+        int   n_rows,                   // number of rows per lsh band
+        int   coreset_size,             // coreset size (0: no coreset)
+        int   dedup,                    // collapse duplicate rows (0: no)
+        int   sketch_size,              // sketch capacity for giant bins (0: no)
+        int   eval_type,                // stat by (0: new seeds, 1: assign)
         float alpha,                    // global alpha
         const char  *folder,            // output folder
-        const DType *dataset,           // data set
-        const u64   *datapos);          // data position
+        const SparseRows<DType> &rows); // data set (raw or packed rows)
     
     // -------------------------------------------------------------------------
     ~KFreqItems();                      // destructor
@@ -43,20 +58,82 @@ public:
 protected:
     int   n_;                       // number of data points
     int   max_iter_;                // maximum iteration
+    float change_ratio_;            // stop if changed labels <= ratio * n
+    float mse_tol_;                 // stop if mse delta <= tol*mse (0: off)
+    int   seed_type_;               // seeding (0: k-means++, 1: k-means||)
+    int   n_rounds_;                // number of k-means|| rounds (0: auto)
+    int   assign_type_;             // assignment type (0-6)
+    int   bitmap_len_;              // min seed length for bitmap (0: none)
+    int   n_bands_;                 // number of lsh bands
+    int   n_rows_;                  // number of rows per lsh band
+    int   coreset_size_;            // coreset size (0: no coreset)
+    int   dedup_;                   // collapse duplicate rows (0: no)
+    int   sketch_size_;             // sketch capacity for giant bins (0: no)
+    int   eval_type_;               // stat by (0: new seeds, 1: assign)
     float alpha_;                   // global \alpha
-    const DType *dataset_;          // data set
-    const u64   *datapos_;          // data position
+    SparseRows<DType> rows_;        // data set (raw or packed rows)
+    const DType *dataset_;          // data set (nullptr: packed rows)
+    const u64   *datapos_;          // data position (nullptr: packed rows)
     char  folder_[200];             // output folder
     
     int   avg_d_;                   // average dimension of sparse data
+    int   max_item_;                // max item id of sparse data
+    std::vector<int>   weights_;    // weights of data (empty: all 1)
+    std::vector<DType> cs_set_;     // coreset (weighted data subset)
+    std::vector<u64>   cs_pos_;     // coreset position
+    std::vector<DType> dd_set_;     // unique rows of data (dedup)
+    std::vector<u64>   dd_pos_;     // unique row position (dedup)
+    std::vector<int>   dd_weights_; // #copies of each unique row (dedup)
+    std::vector<int>   dd_ids_;     // unique row id of each data (dedup)
     int   *labels_;                 // cluster labels
+    int   *best_labels_;            // cluster labels (swap buffer for best)
     std::vector<int> binset_;       // bin set
     std::vector<u64> binpos_;       // bin position
-    std::vector<int> seedset_;      // seed set
+    std::vector<DType> seedset_;    // seed set
     std::vector<u64> seedpos_;      // seed position
+    std::vector<u64> bitset_;       // bit set of long seeds
+    std::vector<u64> bitpos_;       // bit position of long seeds
+    std::vector<DType> best_seedset_; // best seed set
+    std::vector<u64> best_seedpos_; // best seed position
+    int   best_at_;                 // where the best seeds are (0: best_seed*, 
+                                    // 1: seed*, 2: last_seed*)
+    
+    std::vector<int> last_ids_;     // last seed id of each seed
+    std::vector<DType> last_seedset_; // last seed set
+    std::vector<u64> last_seedpos_; // last seed position
+    std::vector<float> upper_;      // upper bound of dist to label (bounds)
+    std::vector<float> lower_;      // lower bound of dist to others (bounds)
+    std::vector<float> dist1_;      // dist to label (incremental)
+    std::vector<float> dist2_;      // dist to 2nd nn seed (incremental)
+    std::vector<int>   id2_;        // id of 2nd nn seed (incremental)
+    std::vector<f64>   busy_;       // busy time of each thread (update)
+    float audit_;                   // fraction of audited labels differing 
+                                    // from the exact assignment (lsh)
     
     // -------------------------------------------------------------------------
     void free();                    // free space for local parameters
+    
+    // -------------------------------------------------------------------------
+    void set_rows(                  // set the data set (and n_)
+        const SparseRows<DType> &rows); // data set (raw or packed rows)
+    
+    // -------------------------------------------------------------------------
+    void use_dedup();               // replace data by unique weighted rows
+    
+    // -------------------------------------------------------------------------
+    void use_coreset(               // replace data by a weighted coreset
+        int k);                         // #clusters (specified by users)
+    
+    // -------------------------------------------------------------------------
+    int assign_data(                // assign data to K seeds by assign_type_
+        int   K,                        // actual number of clusters
+        const int *last_labels,         // last labels (may alias labels_)
+        u64   &pruned,                  // number of pruned dist evals (return)
+        double *stat);                  // sum of w, w*dist, w*dist^2 (return)
+    
+    // -------------------------------------------------------------------------
+    void keep_seeds(                // keep last & best seeds before update
+        int K);                         // actual number of clusters
 };
 
 // -----------------------------------------------------------------------------
@@ -64,18 +141,46 @@ template<class DType>
 KFreqItems<DType>::KFreqItems(      // constructor
     int   n,                            // number of data points
     int   max_iter,                     // maximum iteration
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol*mse (0: off)
+    int   seed_type,                    // seeding (0: k-means++, 1: k-means||)
+    int   n_rounds,                     // number of k-means|| rounds (0: auto)
+    int   assign_type,                  // assignment type (0-6)
+    int   bitmap_len,                   // min seed length for bitmap (0: none)
+    int   n_bands,                      // number of lsh bands
+    int   n_rows,                       // number of rows per lsh band
+    int   coreset_size,                 // coreset size (0: no coreset)
+    int   dedup,                        // collapse duplicate rows (0: no)
+    int   sketch_size,                  // sketch capacity for giant bins (0: no)
+    int   eval_type,                    // stat by (0: new seeds, 1: assign)
     float alpha,                        // global alpha
     const char  *folder,                // output folder
-    const DType *dataset,               // data set
-    const u64   *datapos)               // data position
-    : n_(n), max_iter_(max_iter), alpha_(alpha), dataset_(dataset), datapos_(datapos)
+    const SparseRows<DType> &rows)      // data set (raw or packed rows)
+    : n_(n), max_iter_(max_iter), change_ratio_(change_ratio), 
+    mse_tol_(mse_tol), seed_type_(seed_type), n_rounds_(n_rounds), 
+    assign_type_(assign_type), bitmap_len_(bitmap_len), 
+    n_bands_(n_bands), n_rows_(n_rows), coreset_size_(coreset_size), 
+    dedup_(dedup), sketch_size_(sketch_size), eval_type_(eval_type), 
+    alpha_(alpha), rows_(rows), dataset_(rows.dataset()), 
+    datapos_(rows.datapos()), best_at_(0), audit_(-1.0f)
 {
+    // the other modes scan (or gather) raw rows
+    assert(!rows.packed() || (seed_type == 0 && coreset_size == 0 && 
+        dedup == 0 && (assign_type == 0 || assign_type == 6)));
+    
+    // only the exact & fused assignments get the nn dist of all data
+    if (assign_type != 0 && assign_type != 6) eval_type_ = 0;
+    
     srand(RANDOM_SEED); // fix a random seed
     strncpy(folder_, folder, sizeof(folder_)); // init folder_
-    labels_ = new int[n]; // init label_
+    labels_ = new int[n]; // init label_ (no label yet)
+    best_labels_ = new int[n];
+    std::fill(labels_, labels_+n, -1);
     
-    // calc avg_d, i.e., the average number of non-empty coordinates 
-    avg_d_ = (int) ceil((double) datapos[n] / (double) n);
+    // calc avg_d, i.e., the average number of non-empty coordinates, and 
+    // max_item, i.e., the dimensionality used by the item counters
+    avg_d_ = (int) ceil((double) rows.num_coords() / (double) n);
+    max_item_ = rows.max_item();
 }
 
 // -----------------------------------------------------------------------------
@@ -84,6 +189,7 @@ KFreqItems<DType>::~KFreqItems()    // destructor
 {
     free();
     delete[] labels_;
+    delete[] best_labels_;
 }
 
 // -----------------------------------------------------------------------------
@@ -92,8 +198,37 @@ void KFreqItems<DType>::free()      // free space for local parameters
 {
     std::vector<int>().swap(binset_);
     std::vector<u64>().swap(binpos_);
-    std::vector<int>().swap(seedset_);
+    std::vector<DType>().swap(seedset_);
     std::vector<u64>().swap(seedpos_);
+    std::vector<u64>().swap(bitset_);
+    std::vector<u64>().swap(bitpos_);
+    std::vector<DType>().swap(best_seedset_);
+    std::vector<u64>().swap(best_seedpos_);
+    std::vector<int>().swap(weights_);
+    std::vector<DType>().swap(cs_set_);
+    std::vector<u64>().swap(cs_pos_);
+    std::vector<DType>().swap(dd_set_);
+    std::vector<u64>().swap(dd_pos_);
+    std::vector<int>().swap(dd_weights_);
+    std::vector<int>().swap(dd_ids_);
+    
+    std::vector<int>().swap(last_ids_);
+    std::vector<DType>().swap(last_seedset_);
+    std::vector<u64>().swap(last_seedpos_);
+    std::vector<float>().swap(upper_);
+    std::vector<float>().swap(lower_);
+    std::vector<float>().swap(dist1_);
+    std::vector<float>().swap(dist2_);
+    std::vector<int>().swap(id2_);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void KFreqItems<DType>::set_rows(   // set the data set (and n_)
+    const SparseRows<DType> &rows)      // data set (raw or packed rows)
+{
+    rows_ = rows; n_ = rows.size();
+    dataset_ = rows.dataset(); datapos_ = rows.datapos();
 }
 
 // -----------------------------------------------------------------------------
@@ -103,11 +238,182 @@ void KFreqItems<DType>::display()   // display parameters
     printf("The parameters of KFreqItems:\n");
     printf("n        = %d\n",   n_);
     printf("avg_d    = %d\n",   avg_d_);
+    printf("max_item = %d\n",   max_item_);
     printf("max_iter = %d\n",   max_iter_);
+    printf("changed  = %g\n",   change_ratio_);
+    printf("mse_tol  = %g\n",   mse_tol_);
+    printf("seeding  = %d (rounds = %d)\n", seed_type_, n_rounds_);
+    printf("assign   = %d\n",   assign_type_);
+    printf("bitmap   = %d\n",   bitmap_len_);
+    printf("lsh      = %dx%d\n", n_bands_, n_rows_);
+    printf("coreset  = %d\n",   coreset_size_);
+    printf("dedup    = %d\n",   dedup_);
+    printf("sketch   = %d\n",   sketch_size_);
+    printf("eval     = %d\n",   eval_type_);
     printf("alpha    = %g\n",   alpha_);
     printf("folder   = %s\n\n", folder_);
 }
 
+// -----------------------------------------------------------------------------
+template<class DType>
+void KFreqItems<DType>::use_dedup() // replace data by unique weighted rows
+{
+    std::vector<int> uniq_ids;
+    int m = dedup_data<DType>(n_, dataset_, datapos_, uniq_ids, dd_weights_, 
+        dd_ids_);
+    gather_data<DType>(m, uniq_ids.data(), dataset_, datapos_, dd_set_, dd_pos_);
+    
+#ifdef DEBUG_INFO
+    printf("Dedup: %d unique rows out of %d\n\n", m, n_);
+#endif
+    weights_ = dd_weights_;
+    set_rows(SparseRows<DType>(m, dd_set_.data(), dd_pos_.data()));
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void KFreqItems<DType>::use_coreset(// replace data by a weighted coreset
+    int k)                              // #clusters (specified by users)
+{
+    std::vector<int> cs_ids, cs_weights;
+    int m = build_coreset<DType>(n_, k, coreset_size_, dataset_, datapos_, 
+        weights_.empty() ? nullptr : weights_.data(), cs_ids, cs_weights);
+    if (m < k) { // too few points to hold k clusters, use the whole data
+        printf("Coreset: only %d points for k=%d, use all data\n\n", m, k);
+        return;
+    }
+    weights_.swap(cs_weights);
+    gather_data<DType>(m, cs_ids.data(), dataset_, datapos_, cs_set_, cs_pos_);
+    set_rows(SparseRows<DType>(m, cs_set_.data(), cs_pos_.data()));
+    
+#ifdef DEBUG_INFO
+    printf("Coreset: %d weighted points\n\n", m);
+#endif
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int KFreqItems<DType>::assign_data( // assign data to K seeds by assign_type_
+    int   K,                            // actual number of clusters
+    const int *last_labels,             // last labels (may alias labels_)
+    u64   &pruned,                      // number of pruned dist evals (return)
+    double *stat)                       // sum of w, w*dist, w*dist^2 (return)
+{
+    const DType *seedset = seedset_.data();
+    const u64 *seedpos = seedpos_.data();
+    const u64 *bitset  = bitpos_.empty() ? nullptr : bitset_.data();
+    const u64 *bitpos  = bitpos_.empty() ? nullptr : bitpos_.data();
+    int n_changed = 0; // number of labels changed since last iteration
+    pruned = 0UL;
+    
+    switch (assign_type_) {
+    case 1: // inverted index over seed items
+        n_changed = index_assign_data<DType>(n_, K, dataset_, datapos_, 
+            seedset, seedpos, last_labels, labels_);
+        break;
+    case 2: // triangle-inequality bounds across iterations
+        if (upper_.empty()) { // the first iteration, init bounds
+            upper_.resize(n_); lower_.resize(n_);
+            n_changed = bound_assign_data<DType>(n_, K, dataset_, datapos_, 
+                seedset, seedpos, bitset, bitpos, nullptr, nullptr, 
+                upper_.data(), lower_.data(), last_labels, labels_, pruned);
+        }
+        else {
+            std::vector<float> drift(K), gap(K);
+            calc_seed_drift(K, last_ids_.data(), last_seedset_.data(), 
+                last_seedpos_.data(), seedset, seedpos, drift.data());
+            calc_seed_gap(K, seedset, seedpos, gap.data());
+            
+            n_changed = bound_assign_data<DType>(n_, K, dataset_, datapos_, 
+                seedset, seedpos, bitset, bitpos, drift.data(), gap.data(), 
+                upper_.data(), lower_.data(), last_labels, labels_, pruned);
+        }
+        break;
+    case 3: // length-based lower bound pruning
+        n_changed = length_assign_data<DType>(n_, K, dataset_, datapos_, 
+            seedset, seedpos, bitset, bitpos, last_labels, labels_, pruned);
+        break;
+    case 5: // re-score the changed seeds only (incremental)
+        if (dist1_.empty()) { // the first iteration, init cache
+            dist1_.resize(n_); dist2_.resize(n_); id2_.resize(n_);
+            n_changed = incremental_assign_data<DType>(n_, K, 0, dataset_, 
+                datapos_, seedset, seedpos, bitset, bitpos, 0, nullptr, 
+                nullptr, nullptr, dist1_.data(), dist2_.data(), id2_.data(), 
+                last_labels, labels_, pruned);
+        }
+        else {
+            int n_last = last_ids_.back() + 1;
+            std::vector<int> last_to_new(n_last, -1);
+            for (int j = 0; j < K; ++j) last_to_new[last_ids_[j]] = j;
+            
+            std::vector<int> changed(K), changed_ids(K);
+            int n_updated = find_changed_seeds(K, last_ids_.data(), 
+                last_seedset_.data(), last_seedpos_.data(), seedset, seedpos, 
+                changed.data(), changed_ids.data());
+            
+            n_changed = incremental_assign_data<DType>(n_, K, n_updated, 
+                dataset_, datapos_, seedset, seedpos, bitset, bitpos, n_last, 
+                last_to_new.data(), changed.data(), changed_ids.data(), 
+                dist1_.data(), dist2_.data(), id2_.data(), last_labels, 
+                labels_, pruned);
+        }
+        break;
+    case 4: // approximate assignment by minhash lsh
+        n_changed = lsh_assign_data<DType>(n_, K, n_bands_, n_rows_, dataset_, 
+            datapos_, seedset, seedpos, bitset, bitpos, last_labels, labels_, 
+            audit_);
+        break;
+    default: // exact assignment by linear scan
+        n_changed = exact_assign_data<DType>(n_, K, rows_, seedset, seedpos, 
+            bitset, bitpos, 
+            weights_.empty() ? nullptr : weights_.data(), last_labels, 
+            labels_, stat);
+        break;
+    }
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void KFreqItems<DType>::keep_seeds( // keep last & best seeds before update
+    int K)                              // actual number of clusters
+{
+    // bins_to_seeds will clear seedset_ and seedpos_, so just swap them
+    if (assign_type_ != 2 && assign_type_ != 5) {
+        if (best_at_ == 1) {
+            best_seedset_.swap(seedset_);
+            best_seedpos_.swap(seedpos_);
+            best_at_ = 0;
+        }
+        return;
+    }
+    // bounds and incremental modes also keep the seeds of non-empty bins, 
+    // which are re-numbered in ascending order of their labels
+    if (best_at_ == 2) {
+        best_seedset_.swap(last_seedset_);
+        best_seedpos_.swap(last_seedpos_);
+        best_at_ = 0;
+    }
+    nonempty_labels(n_, K, labels_, last_ids_);
+    
+    last_seedset_.swap(seedset_);
+    last_seedpos_.swap(seedpos_);
+    if (best_at_ == 1) best_at_ = 2;
+}
+
+// -----------------------------------------------------------------------------
+void output_busy_info(              // output busy time of the update threads
+    const std::vector<f64> &busy)       // busy time of each thread
+{
+    if (busy.empty()) return;
+    
+    f64 max_busy = *std::max_element(busy.begin(), busy.end());
+    f64 avg_busy = std::accumulate(busy.begin(), busy.end(), 0.0) / busy.size();
+    printf("update busy time: max=%.3lf, avg=%.3lf seconds (%d threads, "
+        "max/avg=%.2f)\n\n", max_busy, avg_busy, (int) busy.size(), 
+        avg_busy > 0 ? max_busy / avg_busy : 1.0);
+}
+
 // -----------------------------------------------------------------------------
 void output_iter_info(              // output info for each k-freqitems iteration
     int    k,                           // specified number of clusters
@@ -119,6 +425,7 @@ void output_iter_info(              // output info for each k-freqitems iteratio
     double assign_wc_time,              // data assignment wall clock time
     double update_wc_time,              // seed update wall clock time
     double total_wc_time,               // total wall clock time so far
+    float  audit,                       // audited label error (-1: none)
     const  char *folder)                // output folder
 {
     // output binary format
@@ -127,8 +434,10 @@ void output_iter_info(              // output info for each k-freqitems iteratio
     if (!fp) { printf("Could not open %s\n", fname); exit(1); }
     
     fprintf(fp, "%d,%f,%f,%.2lf,", K, mse, mae, total_wc_time);
-    fprintf(fp, "%d,%d,%d,%.2lf+%.2lf=%.2lf\n", k, max_iter, iter, 
+    fprintf(fp, "%d,%d,%d,%.2lf+%.2lf=%.2lf", k, max_iter, iter, 
         assign_wc_time, update_wc_time-assign_wc_time, update_wc_time);
+    if (audit >= 0) fprintf(fp, ",%f", audit);
+    fprintf(fp, "\n");
     fclose(fp);
 }
 
@@ -150,9 +459,11 @@ void output_labels(                 // output labels
 }
 
 // -----------------------------------------------------------------------------
-void output_centers(                // output k centers as seeds
-    int   k,                            // number of seeds
-    const std::vector<int> &seedset,    // seed set (return)
+template<class DType>
+void output_centers(                // output K centers as seeds
+    int   k,                            // specified number of clusters
+    int   K,                            // actual number of seeds
+    const std::vector<DType> &seedset,  // seed set (return)
     const std::vector<u64> &seedpos,    // seed position (return)
     const char *folder)                 // output folder
 {
@@ -160,9 +471,9 @@ void output_centers(                // output k centers as seeds
     FILE *fp = fopen(fname, "wb");
     if (!fp) { printf("Could not open %s\n", fname); exit(1); }
 
-    fwrite(&k, sizeof(int), 1, fp);
-    fwrite(seedpos.data(), sizeof(u64), k+1, fp);
-    fwrite(seedset.data(), sizeof(int), seedpos[k], fp);
+    fwrite(&K, sizeof(int), 1, fp);
+    fwrite(seedpos.data(), sizeof(u64), K+1, fp);
+    fwrite(seedset.data(), sizeof(DType), seedpos[K], fp);
     fclose(fp);
 }
 
@@ -174,12 +485,36 @@ int KFreqItems<DType>::clustering(  // k-freqitems clustering
     double start_wc_time  = omp_get_wtime();
     
     // -------------------------------------------------------------------------
-    //  k-means++ seeding: select k data points as seeds (use OpemMP by default)
+    //  dedup & coreset: run the iterations on unique rows with their #copies
+    //  as weights, and/or on a small weighted summary of the data
+    // -------------------------------------------------------------------------
+    SparseRows<DType> rows = rows_; // the whole data
+    if (dedup_) use_dedup();
+    
+    SparseRows<DType> rows_base = rows_; // assigned at last (unique rows)
+    if (coreset_size_ > 0 && coreset_size_ < n_) use_coreset(k);
+    const int *weights_ptr = weights_.empty() ? nullptr : weights_.data();
+    
+    // -------------------------------------------------------------------------
+    //  k-means++ (or k-means||) seeding: select k data points as seeds (use 
+    //  OpemMP by default)
     // -------------------------------------------------------------------------
     int *distinct_ids = new int[k];
-    int *weights = new int[n_]; memset(weights, 1, sizeof(int)*n_);
-    kmeanspp_seeding<DType>(n_, k, dataset_, datapos_, weights, distinct_ids, 
-        seedset_, seedpos_);
+    int *weights = new int[n_]; 
+    if (weights_ptr) std::copy(weights_ptr, weights_ptr+n_, weights);
+    else std::fill(weights, weights+n_, 1);
+    if (seed_type_ == 1) {
+        kmeansll_seeding<DType>(n_, k, n_rounds_, dataset_, datapos_, weights, 
+            distinct_ids, seedset_, seedpos_);
+    }
+    else {
+        kmeanspp_seeding<DType>(n_, k, rows_, weights, distinct_ids, 
+            seedset_, seedpos_);
+    }
+    if (bitmap_len_ > 0) {
+        build_seed_bitmaps(k, bitmap_len_, seedset_.data(), seedpos_.data(), 
+            bitset_, bitpos_);
+    }
     
     delete[] weights;
     delete[] distinct_ids;
@@ -194,52 +529,182 @@ int KFreqItems<DType>::clustering(  // k-freqitems clustering
     //  assignment-update iterations
     // -------------------------------------------------------------------------
     int K = k; // actual number of clusters (K <= k)
-    f32 mae = -1.0f, mse = -1.0f;
+    f32 mae = -1.0f, mse = -1.0f, last_mse = MAX_FLOAT;
     f64 assign_wc_time, update_wc_time;
     
+    // the labels and seeds of the best iteration are kept by swapping buffers
+    // (rather than copying), and the labels of the last iteration are read by
+    // the assignment in place unless they are the best ones
+    bool best_labels = false; // labels_ holds the best labels
+    int  iter = 0;
+    
     g_mse = MAX_FLOAT;
-    for (int iter = 1; iter <= max_iter_; ++iter) {
-        // data assignment (assign.cu)
+    while (iter < max_iter_) {
+        ++iter;
+        const int *last_labels = labels_;
+        if (best_labels) {
+            std::swap(labels_, best_labels_);
+            last_labels = best_labels_;
+        }
         double local_start_wtime = omp_get_wtime();
-        exact_assign_data<DType>(n_, K, dataset_, datapos_, seedset_.data(), 
-            seedpos_.data(), labels_);
-        assign_wc_time = omp_get_wtime() - local_start_wtime;
-        
-        // update freqitems & re-number the labels in [0,K-1] (bin.cu)
-        K = labels_to_bins(n_, K, labels_, binset_, binpos_);
+        u64 pruned = 0UL;
+        int n_changed = 0, last_K = K;
+        double stat[3] = { 0.0, 0.0, 0.0 }; // sum of w, w*dist, w*dist^2
         
-        // convert bins into seeds (assign.cuh)
-        bins_to_seeds<DType>(n_, K, avg_d_, alpha_, dataset_, datapos_, 
-            binset_.data(), binpos_.data(), seedset_, seedpos_);
+        // for eval_type_ = 1, the stat comes from the nn dist of assignment, 
+        // i.e., it is the stat of the new labels with the last seeds
+        if (eval_type_ == 1) best_labels = false;
+        if (assign_type_ == 6) {
+            // fused assignment & per-cluster counting in one pass, so the 
+            // update only applies the threshold (no bins are built)
+            std::vector<DType> new_seedset;
+            std::vector<int> old_ids(last_K);
+            std::vector<u64> new_seedpos;
+            n_changed = fused_assign_data<DType>(n_, last_K, avg_d_, max_item_, 
+                alpha_, rows_, seedset_.data(), seedpos_.data(), 
+                bitpos_.empty() ? nullptr : bitset_.data(), 
+                bitpos_.empty() ? nullptr : bitpos_.data(), weights_ptr, 
+                last_labels, labels_, K, old_ids.data(), stat, new_seedset, 
+                new_seedpos, busy_);
+            assign_wc_time = omp_get_wtime() - local_start_wtime;
+            
+            if (eval_type_ == 1) {
+                mae = (f32) (stat[1] / stat[0]);
+                mse = (f32) (stat[2] / stat[0]);
+                best_labels = mse < g_mse;
+                if (best_labels) {
+                    keep_assigned_seeds<DType>(K, old_ids.data(), 
+                        seedset_.data(), seedpos_.data(), best_seedset_, 
+                        best_seedpos_);
+                    best_at_ = 0;
+                }
+            }
+            keep_seeds(last_K);
+            seedset_.swap(new_seedset);
+            seedpos_.swap(new_seedpos);
+            if (bitmap_len_ > 0) {
+                build_seed_bitmaps(K, bitmap_len_, seedset_.data(), 
+                    seedpos_.data(), bitset_, bitpos_);
+            }
+        }
+        else {
+            // data assignment (assign.cu)
+            n_changed = assign_data(K, last_labels, pruned, stat);
+            assign_wc_time = omp_get_wtime() - local_start_wtime;
+            
+            if (eval_type_ == 1) {
+                mae = (f32) (stat[1] / stat[0]);
+                mse = (f32) (stat[2] / stat[0]);
+                best_labels = mse < g_mse;
+                if (best_labels) { // non-empty bins in ascending order
+                    std::vector<int> old_ids;
+                    int num = nonempty_labels(n_, K, labels_, old_ids);
+                    keep_assigned_seeds<DType>(num, old_ids.data(), 
+                        seedset_.data(), seedpos_.data(), best_seedset_, 
+                        best_seedpos_);
+                    best_at_ = 0;
+                }
+            }
+            // update freqitems & re-number the labels in [0,K-1] (bin.cu)
+            keep_seeds(K);
+            K = labels_to_bins(n_, K, labels_, binset_, binpos_);
+            
+            // convert bins into seeds (assign.cuh)
+            bins_to_seeds<DType>(n_, K, avg_d_, max_item_, alpha_, rows_, 
+                binset_.data(), binpos_.data(), weights_ptr, sketch_size_, 
+                bitmap_len_, seedset_, seedpos_, bitset_, bitpos_, busy_);
+        }
         
         // evaluation based on new freqitems and new labels
-        calc_stat_by_seeds<DType>(n_, K, labels_, dataset_, datapos_,
-            seedset_.data(), seedpos_.data(), mae, mse);
-        
+        if (eval_type_ == 0) {
+            calc_stat_by_seeds<DType>(n_, K, labels_, rows_, seedset_.data(), 
+                seedpos_.data(), bitpos_.empty() ? nullptr : bitset_.data(), 
+                bitpos_.empty() ? nullptr : bitpos_.data(), weights_ptr, 
+                mae, mse);
+            best_labels = mse < g_mse;
+            if (best_labels) best_at_ = 1;
+        }
         update_wc_time = omp_get_wtime() - local_start_wtime;
         g_tot_wc_time  = omp_get_wtime() - start_wc_time;
         
-        if (mse < g_mse) {
-            g_k = K; g_mae = mae; g_mse = mse; g_iter = iter;
-            g_kpp_wc_time = g_tot_wc_time;
-        }
+        if (best_labels) update_best_stat(K, iter, mae, mse);
         
 #ifdef DEBUG_INFO
         printf("iter=%d/%d, k=%d, mse=%f, mae=%f, time=%.2lf+%.2lf=%.2lf, "
             "total_time=%.2lf\n\n", iter, max_iter_, K, mse, mae, assign_wc_time, 
             update_wc_time-assign_wc_time, update_wc_time, g_tot_wc_time);
+        printf("changed %d/%d labels (%.2f%%)\n\n", n_changed, n_, 
+            100.0 * n_changed / n_);
+        output_busy_info(busy_);
+        if (assign_type_ == 2 || assign_type_ == 3 || assign_type_ == 5) {
+            printf("pruned %lu/%lu distance evaluations (%.2f%%)\n\n", pruned, 
+                (u64) n_*last_K, 100.0 * pruned / ((double) n_*last_K));
+        }
+        if (assign_type_ == 4) {
+            printf("lsh audit: %.2f%% labels differ from exact assignment\n\n", 
+                100.0f * audit_);
+        }
         
         output_iter_info(k, iter, max_iter_, K, mae, mse, assign_wc_time, 
-            update_wc_time, g_tot_wc_time, folder_);
+            update_wc_time, g_tot_wc_time, audit_, folder_);
 #endif
+        if (stop_iteration(n_changed, n_, change_ratio_, mse_tol_, mse, 
+            last_mse)) break;
+    }
+    // move the labels and seeds of the best iteration to labels_ & seedset_
+    if (!best_labels) std::swap(labels_, best_labels_);
+    if (best_at_ == 0) {
+        seedset_.swap(best_seedset_); seedpos_.swap(best_seedpos_);
+    }
+    else if (best_at_ == 2) {
+        seedset_.swap(last_seedset_); seedpos_.swap(last_seedpos_);
+    }
+    best_at_ = 1;
+    
+    // -------------------------------------------------------------------------
+    //  coreset: assign the whole data to the best seeds in a final pass
+    // -------------------------------------------------------------------------
+    if (n_ < rows_base.size()) {
+        set_rows(rows_base);
+        std::vector<int>().swap(weights_);
+        std::vector<DType>().swap(cs_set_);
+        std::vector<u64>().swap(cs_pos_);
+        
+        std::vector<u64>().swap(bitset_);
+        std::vector<u64>().swap(bitpos_);
+        if (bitmap_len_ > 0) {
+            build_seed_bitmaps(g_k, bitmap_len_, seedset_.data(), 
+                seedpos_.data(), bitset_, bitpos_);
+        }
+        stream_assign_data<DType>(n_, g_k, dataset_, datapos_, seedset_.data(), 
+            seedpos_.data(), bitpos_.empty() ? nullptr : bitset_.data(), 
+            bitpos_.empty() ? nullptr : bitpos_.data(), 
+            dd_weights_.empty() ? nullptr : dd_weights_.data(), labels_, 
+            g_mae, g_mse);
+        g_kpp_wc_time = omp_get_wtime() - start_wc_time;
+        
+#ifdef DEBUG_INFO
+        printf("Coreset: assign all data, mse=%f, mae=%f, time=%.2lf\n\n", 
+            g_mse, g_mae, g_kpp_wc_time);
+#endif
+    }
+    
+    // dedup: expand the labels of unique rows to the original rows
+    if (n_ < rows.size()) {
+        int n = rows.size();
+#pragma omp parallel for
+        for (int i = 0; i < n; ++i) best_labels_[i] = labels_[dd_ids_[i]];
+        std::swap(labels_, best_labels_);
+        set_rows(rows);
     }
 #ifdef DEBUG_INFO
+    // output the labels and seeds of the best iteration
     output_labels(n_, k, labels_, folder_);
-    output_centers(k, seedset_, seedpos_, folder_);
+    output_centers(k, g_k, seedset_, seedpos_, folder_);
 #endif
     free();
     g_tot_wc_time  = omp_get_wtime() - start_wc_time;
-    g_iter_wc_time = (g_tot_wc_time  - g_init_wc_time)  / max_iter_;
+    g_iter_wc_time = (g_tot_wc_time  - g_init_wc_time)  / iter;
     
     return 0;
 }
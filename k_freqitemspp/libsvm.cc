@@ -0,0 +1,292 @@
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "util.h"
+
+using namespace clustering;
+
+// -----------------------------------------------------------------------------
+//  Part: the rows parsed by a thread from its range of whole lines
+// -----------------------------------------------------------------------------
+struct Part {
+    std::vector<int> items_;        // items of rows (sorted & unique per row)
+    std::vector<u64> lens_;         // length of each row
+    std::vector<int> labels_;       // label of each row
+    int   max_item_;                // max item id
+    u64   skipped_;                 // number of skipped tokens
+};
+
+// -----------------------------------------------------------------------------
+void usage()                        // display the usage
+{
+    printf("\n"
+        "--------------------------------------------------------------------\n"
+        " Parameters of kpp_libsvm (LIBSVM/CSR text -> binary data)          \n"
+        "--------------------------------------------------------------------\n"
+        " -ds {string}   address of text data set, one row per line as\n"
+        "                \"label idx:val idx:val ...\" (LIBSVM) or\n"
+        "                \"idx idx ...\" (CSR)\n"
+        " -o  {string}   address of binary data set (labels go to\n"
+        "                {address}.labels)\n"
+        " -lb {integer}  first token of a row is its label (0: no, 1: yes)\n"
+        " -b  {integer}  smallest index in the text (e.g., 1 for LIBSVM),\n"
+        "                which becomes item 0\n"
+        " -f  {string}   data format: auto, uint16, int32\n"
+        "\n\n\n");
+}
+
+// -----------------------------------------------------------------------------
+inline bool is_space(               // whether a char separates tokens
+    char  c)                            // input char
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// -----------------------------------------------------------------------------
+inline long parse_int(              // parse a signed integer
+    const char *&p,                     // pointer to text (return)
+    const char *end,                    // end of text
+    bool  &ok)                          // has digits (return)
+{
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    
+    long v = 0; ok = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v*10 + (*p++ - '0'); ok = true;
+    }
+    return neg ? -v : v;
+}
+
+// -----------------------------------------------------------------------------
+void parse_lines(                   // parse the whole lines of a range
+    const char *begin,                  // begin of range (start of a line)
+    const char *end,                    // end of range (end of a line)
+    int   has_label,                    // first token is label (0: no)
+    int   base,                         // smallest index in the text
+    Part  &part)                        // parsed rows (return)
+{
+    part.max_item_ = -1; part.skipped_ = 0UL;
+    
+    const char *p = begin;
+    while (p < end) {
+        const char *eol = (const char*) memchr(p, '\n', end - p);
+        if (eol == nullptr) eol = end;
+        
+        while (p < eol && is_space(*p)) ++p;
+        if (p == eol || *p == '#') { p = eol + 1; continue; } // empty line
+        
+        // the label is the first token (e.g., "+1", "3", "1.0", or "1,5" for
+        // multi-label data, of which the first label is kept)
+        if (has_label) {
+            bool ok; int label = (int) parse_int(p, eol, ok);
+            part.labels_.push_back(label);
+            while (p < eol && !is_space(*p)) ++p;
+        }
+        
+        // items are the indices with non-zero values
+        u64 start = part.items_.size();
+        while (p < eol) {
+            while (p < eol && is_space(*p)) ++p;
+            if (p == eol) break;
+            
+            bool ok; long idx = parse_int(p, eol, ok);
+            bool keep = ok && idx >= base && idx - base <= MAX_INT;
+            if (p < eol && *p == ':') { // value: zero if no digit in 1-9
+                bool nonzero = false;
+                for (++p; p < eol && !is_space(*p); ++p) {
+                    if (*p == 'e' || *p == 'E') break;
+                    nonzero |= (*p >= '1' && *p <= '9');
+                }
+                keep &= nonzero;
+            }
+            while (p < eol && !is_space(*p)) ++p;
+            
+            if (keep) part.items_.push_back((int) (idx - base));
+            else ++part.skipped_;
+        }
+        
+        // sort & remove duplicate items of this row
+        std::vector<int>::iterator first = part.items_.begin() + start;
+        std::sort(first, part.items_.end());
+        part.items_.erase(std::unique(first, part.items_.end()), 
+            part.items_.end());
+        if (part.items_.size() > start) {
+            part.max_item_ = std::max(part.max_item_, part.items_.back());
+        }
+        part.lens_.push_back(part.items_.size() - start);
+        p = eol + 1;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void write_data(                    // write rows in the binary format
+    const std::vector<Part> &parts,     // parsed rows of all threads
+    const std::vector<u64>  &row_start, // id of the first row of each part
+    const std::vector<u64>  &item_start,// first coordinate of each part
+    const char *addr_data)              // address of binary data set
+{
+    int n_parts = (int) parts.size();
+    u64 n = row_start[n_parts], N = item_start[n_parts];
+    
+    // build the positions and convert the items in parallel, then write them
+    // with the same layout as read_sparse_data expects
+    std::vector<u64> datapos(n+1);
+    std::vector<DType> dataset(N);
+    datapos[n] = N;
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < n_parts; ++t) {
+        const Part &part = parts[t];
+        u64 pos = item_start[t];
+        for (size_t i = 0; i < part.lens_.size(); ++i) {
+            datapos[row_start[t]+i] = pos; pos += part.lens_[i];
+        }
+        std::copy(part.items_.begin(), part.items_.end(), 
+            dataset.begin() + item_start[t]);
+    }
+    
+    FILE *fp = fopen(addr_data, "wb");
+    if (!fp) { printf("ERROR: cannot open %s\n", addr_data); exit(1); }
+    if (fwrite(datapos.data(), sizeof(u64), n+1, fp) != n+1 || 
+        fwrite(dataset.data(), sizeof(DType), N, fp) != N) {
+        printf("ERROR: cannot write %s\n", addr_data); exit(1);
+    }
+    fclose(fp);
+}
+
+// -----------------------------------------------------------------------------
+int main(int nargs, char **args)
+{
+    int   has_label = 1;            // first token is label (0: no, 1: yes)
+    int   base = 1;                 // smallest index in the text
+    char  format[20] = "auto";      // data format: auto, uint16, int32
+    char  addr_text[200];           // address of text data set
+    char  addr_data[200];           // address of binary data set
+    
+    int cnt = 1;
+    while (cnt < nargs) {
+        if (strcmp(args[cnt], "-ds") == 0) {
+            strncpy(addr_text, args[++cnt], sizeof(addr_text));
+            printf("addr_text=%s\n", addr_text);
+        }
+        else if (strcmp(args[cnt], "-o") == 0) {
+            strncpy(addr_data, args[++cnt], sizeof(addr_data));
+            printf("addr_data=%s\n", addr_data);
+        }
+        else if (strcmp(args[cnt], "-lb") == 0) {
+            has_label = atoi(args[++cnt]); assert(has_label >= 0);
+            printf("has_label=%d\n", has_label);
+        }
+        else if (strcmp(args[cnt], "-b") == 0) {
+            base = atoi(args[++cnt]); assert(base >= 0);
+            printf("base=%d\n", base);
+        }
+        else if (strcmp(args[cnt], "-f") == 0) {
+            strncpy(format, args[++cnt], sizeof(format));
+            printf("format=%s\n", format);
+        }
+        else {
+            printf("Parameters error!\n"); usage(); exit(1);
+        }
+        ++cnt;
+    }
+    double start_time = omp_get_wtime();
+    
+    // -------------------------------------------------------------------------
+    //  map the text file and split it into ranges of whole lines
+    // -------------------------------------------------------------------------
+    int fd = open(addr_text, O_RDONLY);
+    if (fd < 0) { printf("ERROR: cannot open %s\n", addr_text); exit(1); }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("ERROR: cannot read %s\n", addr_text); exit(1);
+    }
+    u64 length = (u64) st.st_size;
+    const char *text = (const char*) mmap(nullptr, length, PROT_READ, 
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        printf("ERROR: cannot mmap %s\n", addr_text); exit(1);
+    }
+    madvise((void*) text, length, MADV_SEQUENTIAL);
+    
+    // a few ranges per thread, each moved to the start of the next line
+    int n_threads = omp_get_max_threads();
+    int n_parts = std::max(1, (int) std::min((u64) 4*n_threads, length >> 20));
+    std::vector<u64> cut(n_parts+1);
+    cut[0] = 0UL; cut[n_parts] = length;
+    for (int t = 1; t < n_parts; ++t) {
+        u64 c = std::max(cut[t-1], length / n_parts * t);
+        const char *eol = (const char*) memchr(text+c, '\n', length-c);
+        cut[t] = eol != nullptr ? (u64) (eol - text) + 1 : length;
+    }
+    
+    // -------------------------------------------------------------------------
+    //  parse the ranges in parallel, then number the rows in order
+    // -------------------------------------------------------------------------
+    std::vector<Part> parts(n_parts);
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < n_parts; ++t) {
+        parse_lines(text+cut[t], text+cut[t+1], has_label, base, parts[t]);
+    }
+    munmap((void*) text, length);
+    
+    std::vector<u64> row_start(n_parts+1, 0UL), item_start(n_parts+1, 0UL);
+    int max_item = -1; u64 skipped = 0UL;
+    for (int t = 0; t < n_parts; ++t) {
+        row_start[t+1]  = row_start[t]  + parts[t].lens_.size();
+        item_start[t+1] = item_start[t] + parts[t].items_.size();
+        max_item = std::max(max_item, parts[t].max_item_);
+        skipped += parts[t].skipped_;
+    }
+    u64 n = row_start[n_parts], N = item_start[n_parts];
+    if (n == 0 || n > (u64) MAX_INT) {
+        printf("ERROR: %lu rows in %s\n", n, addr_text); exit(1);
+    }
+    double parse_time = omp_get_wtime() - start_time;
+    
+    // -------------------------------------------------------------------------
+    //  write the binary data (uint16 if all items fit) & the labels
+    // -------------------------------------------------------------------------
+    if (strcmp(format, "auto") == 0) {
+        strcpy(format, max_item < 65536 ? "uint16" : "int32");
+    }
+    if (strcmp(format, "uint16") == 0 && max_item < 65536) {
+        write_data<u16>(parts, row_start, item_start, addr_data);
+    }
+    else if (strcmp(format, "int32") == 0) {
+        write_data<int>(parts, row_start, item_start, addr_data);
+    }
+    else {
+        printf("Parameters error! (max item = %d)\n", max_item); usage();
+        exit(1);
+    }
+    
+    if (has_label) {
+        char fname[210]; sprintf(fname, "%s.labels", addr_data);
+        FILE *fp = fopen(fname, "wb");
+        if (!fp) { printf("ERROR: cannot open %s\n", fname); exit(1); }
+        for (int t = 0; t < n_parts; ++t) {
+            const std::vector<int> &labels = parts[t].labels_;
+            if (fwrite(labels.data(), sizeof(int), labels.size(), fp) != 
+                labels.size()) {
+                printf("ERROR: cannot write %s\n", fname); exit(1);
+            }
+        }
+        fclose(fp);
+    }
+    
+    printf("\nn=%lu, N=%lu, max_item=%d, format=%s, skipped %lu tokens, "
+        "time=%.2lf+%.2lf seconds (%.2lf MB/s)\n", n, N, max_item, format, 
+        skipped, parse_time, omp_get_wtime() - start_time - parse_time, 
+        length / 1048576.0 / parse_time);
+    printf("run: ./kpp -n %lu -f %s -ds %s ...\n\n", n, format, addr_data);
+    
+    return 0;
+}
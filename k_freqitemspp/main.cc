@@ -8,6 +8,8 @@
 
 #include "util.h"
 #include "k_freqitems.h"
+#include "stream.h"
+#include "packed.h"
 
 using namespace clustering;
 
@@ -21,6 +23,32 @@ void usage()                        // display the usage
         " -n  {integer}  number of data points in a data set\n"
         " -k  {integer}  number of clusters\n"
         " -m  {integer}  maximum iterations\n"
+        " -ct {real}     stop if the fraction of changed labels <= ct\n"
+        " -dt {real}     stop if the relative mse delta <= dt (0: off)\n"
+        " -sd {integer}  seeding type (0: k-means++, 1: k-means||)\n"
+        " -sr {integer}  number of k-means|| rounds (0: ceil(ln(cost)))\n"
+        " -am {integer}  assignment type (0: exact, 1: inverted index,\n"
+        "                2: triangle-inequality bounds, 3: length pruning,\n"
+        "                4: minhash lsh, 5: re-score changed seeds only,\n"
+        "                6: exact, fused with per-cluster item counting)\n"
+        " -lb {integer}  number of lsh bands (recall up, speed down)\n"
+        " -lr {integer}  number of rows per lsh band (recall down, speed up)\n"
+        " -cs {integer}  coreset size by sensitivity sampling (0: none)\n"
+        " -dd {integer}  collapse duplicate rows into weights (0: no, 1: yes)\n"
+        " -hh {integer}  heavy-hitter sketch capacity for the bins with more\n"
+        "                coordinates than it (0: exact counting; not with\n"
+        "                -am 6, which counts exactly in one pass)\n"
+        " -es {integer}  source of mse & mae (0: a pass over the new seeds,\n"
+        "                1: nn dist of the next assignment; -am 0 or 6)\n"
+        " -mm {integer}  load data by (0: fread, 1: mmap, 2: mmap and\n"
+        "                prefault pages by all threads)\n"
+        " -oc {integer}  out-of-core mode with chunks of this size in MB\n"
+        "                (0: in memory; uses -m, -ct, -dt, -bm and -a only)\n"
+        " -pk {integer}  data set is packed by kpp_pack (0: no, 1: yes; with\n"
+        "                -sd 0 and -am 0 or 6 only, not with -cs, -dd, -mm\n"
+        "                or -oc)\n"
+        " -bm {integer}  min seed length to store a seed as bitmap (0: none;\n"
+        "                ignored by -am 1)\n"
         " -GA {real}     global alpha\n"
         " -LA {real}     local  alpha\n"
         " -F  {string}   data format: uint16, int32\n"
@@ -29,11 +57,50 @@ void usage()                        // display the usage
         "\n\n\n");
 }
 
+// -----------------------------------------------------------------------------
+void output_summary(                // display & write the results of a setting
+    int   k,                            // number of clusters
+    int   max_iter,                     // maximum iterations
+    float alpha,                        // global alpha
+    const char *fname)                  // address of summary file (csv)
+{
+    printf("K = %d, MSE = %f, MAE = %f, K-FreqItems++ = %.2lf Seconds\n", 
+        g_k, g_mse, g_mae, g_kpp_wc_time);
+    printf("Init = %.2lf Seconds\n", g_init_wc_time);
+    printf("Iter = %.2lf Seconds\n", g_iter_wc_time);
+    printf("Tot  = %.2lf Seconds\n", g_tot_wc_time);
+    printf("\n");
+    
+    // write the results of each setting to disk
+    FILE *fp = fopen(fname, "a+");
+    if (!fp) { printf("ERROR: cannot open %s\n", fname); return; }
+    
+    fprintf(fp, "%d,%f,%f,%.2lf,", g_k, g_mse, g_mae, g_kpp_wc_time);
+    fprintf(fp, "%d,%d,%d,%g,%.2lf,%.2lf,%.2lf\n", k, max_iter, g_iter, 
+        alpha, g_init_wc_time, g_iter_wc_time, g_tot_wc_time);
+    fclose(fp);
+}
+
 // -----------------------------------------------------------------------------
 template<class DType>
 void kfreqitems_impl(               // k-freqitems implementation
     int   n,                            // number of data points
     int   k,                            // number of clusters
+    int   max_iter,                     // maximum iterations
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol * mse
+    int   seed_type,                    // seeding type
+    int   n_rounds,                     // number of k-means|| rounds
+    int   assign_type,                  // assignment type
+    int   bitmap_len,                   // min seed length for bitmap
+    int   n_bands,                      // number of lsh bands
+    int   n_rows,                       // number of rows per lsh band
+    int   coreset_size,                 // coreset size
+    int   dedup,                        // collapse duplicate rows
+    int   sketch_size,                  // sketch capacity for giant bins
+    int   eval_type,                    // source of mse & mae
+    int   load_type,                    // load data by (0: fread, 1-2: mmap)
+    int   packed,                       // data set is packed (0: no, 1: yes)
     float alpha,                        // global alpha
     const char *addr_data,              // address of data set
     const char *folder)                 // output folder to store output files
@@ -44,50 +111,82 @@ void kfreqitems_impl(               // k-freqitems implementation
     // -------------------------------------------------------------------------
     //  read dataset & init k-freqitems++
     // -------------------------------------------------------------------------
-    DType *dataset = nullptr;
-    u64   *datapos = new u64[n+1];
-    dataset = read_sparse_data<DType>(n, addr_data, datapos);
+    const DType *dataset = nullptr;
+    const u64   *datapos = nullptr;
+    PackedData  *data    = nullptr; // packed data set (packed rows)
+    void  *map_addr = nullptr;      // start address of mapping (mmap)
+    u64   map_len   = 0UL;          // length of mapping (mmap)
+    if (packed > 0) {
+        data = new PackedData();
+        data->load(n, addr_data);
+    }
+    else if (load_type > 0) {
+        dataset = map_sparse_data<DType>(n, addr_data, load_type == 2, 
+            datapos, map_addr, map_len);
+    }
+    else {
+        u64 *pos = new u64[n+1];
+        dataset = read_sparse_data<DType>(n, addr_data, pos);
+        datapos = pos;
+    }
+    printf("SIMD = %s\n\n", simd_name());
 
-    FILE *fp = nullptr;
     char fname[100]; sprintf(fname, "%skFreqItems++.csv", folder);
     create_dir(fname);
-    // fp = fopen(fname, "a+");
+    // FILE *fp = fopen(fname, "a+");
     // if (!fp) { printf("Could not open %s\n", fname); exit(1); }
     // fprintf(fp, "K,MSE,MAE,WTime,k,MaxIter,Iter,");
     // fprintf(fp, "Alpha,InitWTime,IterWTime,TotWTime\n");
     // fclose(fp);
     
-    KFreqItems<DType> *k_freqitems = new KFreqItems<DType>(n, MAX_ITER, alpha, 
-        folder, (const DType*) dataset, (const u64*) datapos);
+    SparseRows<DType> rows = data != nullptr ? SparseRows<DType>(data) : 
+        SparseRows<DType>(n, dataset, datapos);
+    KFreqItems<DType> *k_freqitems = new KFreqItems<DType>(n, max_iter, 
+        change_ratio, mse_tol, seed_type, n_rounds, assign_type, bitmap_len, 
+        n_bands, n_rows, coreset_size, dedup, sketch_size, eval_type, alpha, 
+        folder, rows);
     
     // -------------------------------------------------------------------------
     //  k_freqitems: k-modes clustering for sparse data
     // -------------------------------------------------------------------------
     int ret = k_freqitems->clustering(k);
     
-    if (ret == 0) {
-        printf("K = %d, MSE = %f, MAE = %f, K-FreqItems++ = %.2lf Seconds\n", 
-            g_k, g_mse, g_mae, g_kpp_wc_time);
-        printf("Init = %.2lf Seconds\n", g_init_wc_time);
-        printf("Iter = %.2lf Seconds\n", g_iter_wc_time);
-        printf("Tot  = %.2lf Seconds\n", g_tot_wc_time);
-        printf("\n");
-        
-        // write the results of each setting to disk
-        fp = fopen(fname, "a+");
-        if (!fp) { printf("ERROR: cannot open %s\n", fname); return; }
-        
-        fprintf(fp, "%d,%f,%f,%.2lf,", g_k, g_mse, g_mae, g_kpp_wc_time);
-        fprintf(fp, "%d,%d,%d,%g,%.2lf,%.2lf,%.2lf\n", k, MAX_ITER, g_iter, 
-            alpha, g_init_wc_time, g_iter_wc_time, g_tot_wc_time);
-        fclose(fp);
-    }
-    delete   k_freqitems;
-    delete[] dataset;
-    delete[] datapos;
+    if (ret == 0) output_summary(k, max_iter, alpha, fname);
+    delete k_freqitems;
+    if (map_addr != nullptr) munmap(map_addr, map_len);
+    else { delete[] dataset; delete[] datapos; }
+    delete data;
 }
 
 
+// -----------------------------------------------------------------------------
+template<class DType>
+void stream_kfreqitems_impl(        // out-of-core k-freqitems implementation
+    int   n,                            // number of data points
+    int   k,                            // number of clusters
+    int   max_iter,                     // maximum iterations
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol * mse
+    int   bitmap_len,                   // min seed length for bitmap
+    int   chunk_size,                   // chunk size (MB)
+    float alpha,                        // global alpha
+    const char *addr_data,              // address of data set
+    const char *folder)                 // output folder to store output files
+{
+    printf("SIMD = %s\n\n", simd_name());
+    
+    char fname[100]; sprintf(fname, "%skFreqItems++.csv", folder);
+    create_dir(fname);
+    
+    StreamKFreqItems<DType> *k_freqitems = new StreamKFreqItems<DType>(n, 
+        max_iter, change_ratio, mse_tol, bitmap_len, chunk_size, alpha, folder, 
+        addr_data);
+    
+    int ret = k_freqitems->clustering(k);
+    if (ret == 0) output_summary(k, max_iter, alpha, fname);
+    delete k_freqitems;
+}
+
 // -----------------------------------------------------------------------------
 int main(int nargs, char **args)
 {
@@ -95,6 +194,22 @@ int main(int nargs, char **args)
     
     int   n     = -1;               // number of data points
     int   k     = -1;               // number of seeds
+    int   max_iter = MAX_ITER;      // maximum iterations
+    float change_ratio = 0.0f;      // stop if changed labels <= ratio * n
+    float mse_tol = 0.0f;           // stop if mse delta <= tol*mse (0: off)
+    int   seed_type = 0;            // seeding (0: k-means++, 1: k-means||)
+    int   n_rounds = 0;             // number of k-means|| rounds (0: auto)
+    int   assign_type = 0;          // assignment type
+    int   bitmap_len = 0;           // min seed length for bitmap (0: none)
+    int   n_bands = 16;             // number of lsh bands
+    int   n_rows  = 2;              // number of rows per lsh band
+    int   coreset_size = 0;         // coreset size (0: no coreset)
+    int   dedup = 0;                // collapse duplicate rows (0: no)
+    int   sketch_size = 0;          // sketch capacity for giant bins (0: no)
+    int   eval_type = 0;            // stat by (0: new seeds, 1: assign)
+    int   load_type = 0;            // load data by (0: fread, 1-2: mmap)
+    int   chunk_size = 0;           // chunk size in MB (0: in memory)
+    int   packed = 0;               // data set is packed (0: no, 1: yes)
     float alpha = -1.0f;            // global \alpha
     char  format[20];               // data format: uint8,uint16,int32,float32
     char  addr_data[200];           // address of data set
@@ -110,6 +225,70 @@ int main(int nargs, char **args)
             k = atoi(args[++cnt]); assert(k > 0);
             printf("k=%d\n", k);
         }
+        else if (strcmp(args[cnt], "-m") == 0) {
+            max_iter = atoi(args[++cnt]); assert(max_iter > 0);
+            printf("max_iter=%d\n", max_iter);
+        }
+        else if (strcmp(args[cnt], "-ct") == 0) {
+            change_ratio = atof(args[++cnt]); assert(change_ratio >= 0);
+            printf("change_ratio=%g\n", change_ratio);
+        }
+        else if (strcmp(args[cnt], "-dt") == 0) {
+            mse_tol = atof(args[++cnt]); assert(mse_tol >= 0);
+            printf("mse_tol=%g\n", mse_tol);
+        }
+        else if (strcmp(args[cnt], "-sd") == 0) {
+            seed_type = atoi(args[++cnt]); assert(seed_type >= 0);
+            printf("seed_type=%d\n", seed_type);
+        }
+        else if (strcmp(args[cnt], "-sr") == 0) {
+            n_rounds = atoi(args[++cnt]); assert(n_rounds >= 0);
+            printf("n_rounds=%d\n", n_rounds);
+        }
+        else if (strcmp(args[cnt], "-am") == 0) {
+            assign_type = atoi(args[++cnt]); assert(assign_type >= 0);
+            printf("assign_type=%d\n", assign_type);
+        }
+        else if (strcmp(args[cnt], "-bm") == 0) {
+            bitmap_len = atoi(args[++cnt]); assert(bitmap_len >= 0);
+            printf("bitmap_len=%d\n", bitmap_len);
+        }
+        else if (strcmp(args[cnt], "-lb") == 0) {
+            n_bands = atoi(args[++cnt]); assert(n_bands > 0);
+            printf("n_bands=%d\n", n_bands);
+        }
+        else if (strcmp(args[cnt], "-lr") == 0) {
+            n_rows = atoi(args[++cnt]); assert(n_rows > 0);
+            printf("n_rows=%d\n", n_rows);
+        }
+        else if (strcmp(args[cnt], "-cs") == 0) {
+            coreset_size = atoi(args[++cnt]); assert(coreset_size >= 0);
+            printf("coreset_size=%d\n", coreset_size);
+        }
+        else if (strcmp(args[cnt], "-dd") == 0) {
+            dedup = atoi(args[++cnt]); assert(dedup >= 0);
+            printf("dedup=%d\n", dedup);
+        }
+        else if (strcmp(args[cnt], "-hh") == 0) {
+            sketch_size = atoi(args[++cnt]); assert(sketch_size >= 0);
+            printf("sketch_size=%d\n", sketch_size);
+        }
+        else if (strcmp(args[cnt], "-es") == 0) {
+            eval_type = atoi(args[++cnt]); assert(eval_type >= 0);
+            printf("eval_type=%d\n", eval_type);
+        }
+        else if (strcmp(args[cnt], "-mm") == 0) {
+            load_type = atoi(args[++cnt]); assert(load_type >= 0);
+            printf("load_type=%d\n", load_type);
+        }
+        else if (strcmp(args[cnt], "-oc") == 0) {
+            chunk_size = atoi(args[++cnt]); assert(chunk_size >= 0);
+            printf("chunk_size=%d\n", chunk_size);
+        }
+        else if (strcmp(args[cnt], "-pk") == 0) {
+            packed = atoi(args[++cnt]); assert(packed >= 0);
+            printf("packed=%d\n", packed);
+        }
         else if (strcmp(args[cnt], "-a") == 0) {
             alpha = atof(args[++cnt]); assert(alpha >= 0);
             printf("alpha=%g\n", alpha);
@@ -133,14 +312,48 @@ int main(int nargs, char **args)
         }
         ++cnt;
     }
+    // the fused assignment (-am 6) counts the items of all clusters exactly 
+    // in the same pass, so it has no bins to summarize by the sketch
+    if (sketch_size > 0 && assign_type == 6) {
+        printf("Parameters error: -hh cannot be used with -am 6!\n"); 
+        usage(); exit(1);
+    }
+    // packed rows are unpacked on the fly by the k-means++ seeding and the 
+    // exact & fused assignments; the other modes scan or gather raw rows
+    if (packed > 0 && (seed_type != 0 || (assign_type != 0 && 
+        assign_type != 6) || coreset_size > 0 || dedup > 0 || load_type > 0 || 
+        chunk_size > 0)) {
+        printf("Parameters error: -pk only supports -sd 0 and -am 0 or 6!\n"); 
+        usage(); exit(1);
+    }
+    // the inverted index (-am 1) gets the overlaps from the posting lists of 
+    // seed items and never scans a seed, so no bitmaps are built for it
+    if (bitmap_len > 0 && assign_type == 1 && packed == 0 && chunk_size == 0) {
+        printf("Warning: -bm is ignored by -am 1\n\n");
+        bitmap_len = 0;
+    }
     // -------------------------------------------------------------------------
     //  methods 
     // -------------------------------------------------------------------------
-    if (strcmp(format, "uint16") == 0) {
-        kfreqitems_impl<u16>(n, k, alpha, addr_data, folder);
+    if (chunk_size > 0 && strcmp(format, "uint16") == 0) {
+        stream_kfreqitems_impl<u16>(n, k, max_iter, change_ratio, mse_tol, 
+            bitmap_len, chunk_size, alpha, addr_data, folder);
+    }
+    else if (chunk_size > 0 && strcmp(format, "int32") == 0) {
+        stream_kfreqitems_impl<int>(n, k, max_iter, change_ratio, mse_tol, 
+            bitmap_len, chunk_size, alpha, addr_data, folder);
+    }
+    else if (strcmp(format, "uint16") == 0) {
+        kfreqitems_impl<u16>(n, k, max_iter, change_ratio, mse_tol, 
+            seed_type, n_rounds, assign_type, bitmap_len, n_bands, n_rows, 
+            coreset_size, dedup, sketch_size, eval_type, load_type, packed, 
+            alpha, addr_data, folder);
     }
     else if (strcmp(format, "int32") == 0) {
-        kfreqitems_impl<int>(n, k, alpha, addr_data, folder);
+        kfreqitems_impl<int>(n, k, max_iter, change_ratio, mse_tol, 
+            seed_type, n_rounds, assign_type, bitmap_len, n_bands, n_rows, 
+            coreset_size, dedup, sketch_size, eval_type, load_type, packed, 
+            alpha, addr_data, folder);
     }
     else {
         printf("Parameters error!\n"); usage();
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "util.h"
+#include "packed.h"
+
+using namespace clustering;
+
+// -----------------------------------------------------------------------------
+void usage()                        // display the usage
+{
+    printf("\n"
+        "--------------------------------------------------------------------\n"
+        " Parameters of kpp_pack (binary data -> packed data for -pk 1)      \n"
+        "--------------------------------------------------------------------\n"
+        " -n  {integer}  number of data points in a data set\n"
+        " -f  {string}   data format: uint16, int32\n"
+        " -ds {string}   address of data set (binary)\n"
+        " -o  {string}   address of packed data set\n"
+        " -fc {integer}  save it even if it is not smaller (0: no, 1: yes)\n"
+        "\n\n\n");
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void pack_impl(                     // pack a data set & save it to disk
+    int   n,                            // number of data points
+    int   force,                        // save it even if not smaller
+    const char *addr_data,              // address of data set
+    const char *addr_pack)              // address of packed data set
+{
+    u64 *datapos = new u64[n+1];
+    DType *dataset = read_sparse_data<DType>(n, addr_data, datapos);
+    
+    double start_time = omp_get_wtime();
+    PackedData data;
+    data.pack<DType>(n, dataset, datapos);
+    
+    // sparse u16 rows may not shrink (e.g., large deltas take 2 bytes plus 
+    // the control bits, and the row offsets are not smaller than datapos), 
+    // so such data is only saved by request
+    u64 raw = (u64) (n+1)*sizeof(u64) + datapos[n]*sizeof(DType);
+    if (data.num_bytes() >= raw && !force) {
+        printf("packed %lu -> %lu bytes (%.2fx) is not smaller, not saved "
+            "(use -fc 1 to save it anyway)\n", raw, data.num_bytes(), 
+            (double) raw / data.num_bytes());
+        exit(1);
+    }
+    data.save(addr_pack);
+    
+    // check that every row is unpacked into the same items
+    std::vector<DType> buf(data.max_len());
+    for (int i = 0; i < n; ++i) {
+        int len = data.unpack<DType>(i, buf.data());
+        assert(len == get_length(i, datapos));
+        assert(std::equal(buf.data(), buf.data()+len, dataset+datapos[i]));
+    }
+    printf("packed %lu -> %lu bytes (%.2fx), time=%.2lf seconds, path=%s\n", 
+        raw, data.num_bytes(), (double) raw / data.num_bytes(), 
+        omp_get_wtime() - start_time, addr_pack);
+    
+    delete[] dataset;
+    delete[] datapos;
+}
+
+// -----------------------------------------------------------------------------
+int main(int nargs, char **args)
+{
+    int   n = -1;                   // number of data points
+    char  format[20];               // data format: uint16, int32
+    char  addr_data[200];           // address of data set
+    char  addr_pack[200];           // address of packed data set
+    int   force = 0;                // save it even if it is not smaller
+    
+    int cnt = 1;
+    while (cnt < nargs) {
+        if (strcmp(args[cnt], "-n") == 0) {
+            n = atoi(args[++cnt]); assert(n > 0);
+            printf("n=%d\n", n);
+        }
+        else if (strcmp(args[cnt], "-f") == 0) {
+            strncpy(format, args[++cnt], sizeof(format));
+            printf("format=%s\n", format);
+        }
+        else if (strcmp(args[cnt], "-ds") == 0) {
+            strncpy(addr_data, args[++cnt], sizeof(addr_data));
+            printf("addr_data=%s\n", addr_data);
+        }
+        else if (strcmp(args[cnt], "-o") == 0) {
+            strncpy(addr_pack, args[++cnt], sizeof(addr_pack));
+            printf("addr_pack=%s\n", addr_pack);
+        }
+        else if (strcmp(args[cnt], "-fc") == 0) {
+            force = atoi(args[++cnt]); assert(force >= 0);
+            printf("force=%d\n", force);
+        }
+        else {
+            printf("Parameters error!\n"); usage(); exit(1);
+        }
+        ++cnt;
+    }
+    
+    if (strcmp(format, "uint16") == 0) {
+        pack_impl<u16>(n, force, addr_data, addr_pack);
+    }
+    else if (strcmp(format, "int32") == 0) {
+        pack_impl<int>(n, force, addr_data, addr_pack);
+    }
+    else {
+        printf("Parameters error!\n"); usage();
+    }
+    return 0;
+}
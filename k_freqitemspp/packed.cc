@@ -0,0 +1,206 @@
+#include "packed.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+template<class T>
+static void scalar_unpack(          // scalar decoder of a packed row
+    int   len,                          // number of items
+    const u08 *ctrl,                    // control bytes
+    const u08 *data,                    // data bytes
+    T     *items)                       // items (return)
+{
+    u32 prev = 0;
+    for (int j = 0; j < len; ++j) {
+        int code = (ctrl[j>>2] >> ((j & 3) << 1)) & 3;
+        u32 delta = data[0];
+        if (code > 0) delta |= (u32) data[1] << 8;
+        if (code > 1) delta |= (u32) data[2] << 16;
+        if (code > 2) delta |= (u32) data[3] << 24;
+        data += code + 1;
+        
+        prev += delta; items[j] = (T) prev;
+    }
+}
+
+#ifdef SIMD_X86
+// -----------------------------------------------------------------------------
+//  Stream VByte decoder: each control byte selects a shuffle that spreads the
+//  4-13 data bytes of 4 deltas into 4 int32 lanes (pshufb), then the deltas
+//  are prefix-summed in the register; the tail of < 4 items is decoded by the
+//  scalar decoder. The loads may read up to 16 bytes after the last delta, so
+//  the packed rows are followed by PACK_PAD zero bytes.
+// -----------------------------------------------------------------------------
+struct ShuffleTable {
+    u08 shuf_[256][16];             // shuffle mask of each control byte
+    u08 size_[256];                 // number of data bytes of each control byte
+    
+    ShuffleTable() {
+        for (int c = 0; c < 256; ++c) {
+            int size = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                int n_bytes = ((c >> (lane << 1)) & 3) + 1;
+                for (int b = 0; b < 4; ++b) {
+                    shuf_[c][lane*4+b] = b < n_bytes ? (u08) (size++) : 0x80;
+                }
+            }
+            size_[c] = (u08) size;
+        }
+    }
+};
+
+static const ShuffleTable g_table;  // shuffle table of Stream VByte
+
+// -----------------------------------------------------------------------------
+__attribute__((target("sse4.1")))
+static inline void store_x4(int *p, __m128i v)
+{
+    _mm_storeu_si128((__m128i*) p, v);
+}
+
+// -----------------------------------------------------------------------------
+__attribute__((target("sse4.1")))
+static inline void store_x4(u16 *p, __m128i v)
+{
+    _mm_storel_epi64((__m128i*) p, _mm_packus_epi32(v, v));
+}
+
+// -----------------------------------------------------------------------------
+template<class T>
+__attribute__((target("sse4.1")))
+static void sse_unpack(             // SSE4.1 decoder of a packed row
+    int   len,                          // number of items
+    const u08 *ctrl,                    // control bytes
+    const u08 *data,                    // data bytes
+    T     *items)                       // items (return)
+{
+    __m128i prev = _mm_setzero_si128();
+    int j = 0;
+    for (; j+4 <= len; j += 4) {
+        u08 c = ctrl[j>>2];
+        __m128i v = _mm_loadu_si128((const __m128i*) data);
+        __m128i m = _mm_loadu_si128((const __m128i*) g_table.shuf_[c]);
+        v = _mm_shuffle_epi8(v, m);
+        data += g_table.size_[c];
+        
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, prev);
+        prev = _mm_shuffle_epi32(v, 0xFF);
+        store_x4(items+j, v);
+    }
+    if (j < len) {
+        // decode the tail relative to the last item, then add it back
+        u32 base = (u32) _mm_cvtsi128_si32(prev);
+        scalar_unpack<T>(len-j, ctrl + (j>>2), data, items+j);
+        for (int l = j; l < len; ++l) items[l] = (T) (base + (u32) items[l]);
+    }
+}
+#endif
+
+// -----------------------------------------------------------------------------
+template<class T>
+static void (*select_unpack())(int, const u08*, const u08*, T*)
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) return sse_unpack<T>;
+#endif
+    return scalar_unpack<T>;
+}
+
+unpack_int_func g_unpack_int = select_unpack<int>();
+unpack_u16_func g_unpack_u16 = select_unpack<u16>();
+
+// -----------------------------------------------------------------------------
+PackedData::PackedData()            // constructor
+    : n_(0), N_(0UL), max_len_(0), max_item_(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+PackedData::~PackedData()           // destructor
+{
+}
+
+// -----------------------------------------------------------------------------
+void PackedData::calc_max_len()     // calc max_len_ by the row lengths
+{
+    int max_len = 0;
+#pragma omp parallel for reduction(max:max_len)
+    for (int i = 0; i < n_; ++i) max_len = std::max(max_len, length(i));
+    max_len_ = max_len;
+}
+
+// -----------------------------------------------------------------------------
+u64 PackedData::num_bytes() const   // number of bytes of rows & offsets
+{
+    return blockpos_.size()*sizeof(u64) + rowoff_.size()*sizeof(u32) + 
+        (bytes_.empty() ? 0UL : bytes_.size() - PACK_PAD);
+}
+
+// -----------------------------------------------------------------------------
+void PackedData::load(              // load packed data from disk
+    int   n,                            // number of data points
+    const char *fname)                  // address of packed data
+{
+    double start_time = omp_get_wtime();
+    
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) { printf("ERROR: cannot open %s\n", fname); exit(1); }
+    
+    // read the header, the block offsets, and then the row offsets
+    n_ = n;
+    int n_blocks = (n + PACK_BLOCK - 1) / PACK_BLOCK;
+    u64 head[2]; // N & max item
+    blockpos_.resize(n_blocks+1); rowoff_.resize(n);
+    if (fread(head, sizeof(u64), 2, fp) != 2 || 
+        fread(blockpos_.data(), sizeof(u64), n_blocks+1, fp) != 
+            (size_t) n_blocks+1 || 
+        fread(rowoff_.data(), sizeof(u32), n, fp) != (size_t) n) {
+        printf("ERROR: cannot read %d row offsets from %s\n", n, fname);
+        exit(1);
+    }
+    N_ = head[0]; max_item_ = (int) head[1];
+    
+    // read the packed rows
+    u64 size = blockpos_[n_blocks];
+    bytes_.assign(size + PACK_PAD, 0);
+    if (fread(bytes_.data(), 1, size, fp) != size) {
+        printf("ERROR: cannot read %lu bytes from %s\n", size, fname);
+        exit(1);
+    }
+    fclose(fp);
+    calc_max_len();
+    
+    double loading_time = omp_get_wtime() - start_time;
+    printf("\nn=%d, N=%lu, %.2lf bytes/coordinate, time=%.2lf seconds "
+        "(packed), path=%s\n\n", n, N_, (double) num_bytes() / N_, 
+        loading_time, fname);
+}
+
+// -----------------------------------------------------------------------------
+void PackedData::save(              // save packed data to disk
+    const char *fname) const            // address of packed data
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) { printf("ERROR: cannot open %s\n", fname); exit(1); }
+    
+    u64 head[2] = { N_, (u64) max_item_ }; // N & max item
+    u64 size = blockpos_.back();
+    if (fwrite(head, sizeof(u64), 2, fp) != 2 || 
+        fwrite(blockpos_.data(), sizeof(u64), blockpos_.size(), fp) != 
+            blockpos_.size() || 
+        fwrite(rowoff_.data(), sizeof(u32), n_, fp) != (size_t) n_ || 
+        fwrite(bytes_.data(), 1, size, fp) != size) {
+        printf("ERROR: cannot write %s\n", fname); exit(1);
+    }
+    fclose(fp);
+}
+
+} // end namespace clustering
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
+#include "def.h"
+#include "util.h"
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+//  packed rows: each row (sorted items) is stored as a varint length followed
+//  by the Stream VByte encoding of its deltas, i.e., (len+3)/4 control bytes
+//  with a 2-bit byte length for each delta, and then the 1-4 bytes of each
+//  delta; the decoders (runtime CPU dispatch) also undo the deltas
+// -----------------------------------------------------------------------------
+typedef void (*unpack_int_func)(int, const u08*, const u08*, int*);
+typedef void (*unpack_u16_func)(int, const u08*, const u08*, u16*);
+
+extern unpack_int_func g_unpack_int; // decoder for int data
+extern unpack_u16_func g_unpack_u16; // decoder for u16 data
+
+// -----------------------------------------------------------------------------
+inline void svb_decode(             // decode deltas into sorted items
+    int   len,                          // number of items
+    const u08 *ctrl,                    // control bytes
+    const u08 *data,                    // data bytes
+    int   *items)                       // items (return)
+{
+    g_unpack_int(len, ctrl, data, items);
+}
+
+// -----------------------------------------------------------------------------
+inline void svb_decode(             // decode deltas into sorted items
+    int   len,                          // number of items
+    const u08 *ctrl,                    // control bytes
+    const u08 *data,                    // data bytes
+    u16   *items)                       // items (return)
+{
+    g_unpack_u16(len, ctrl, data, items);
+}
+
+// -----------------------------------------------------------------------------
+inline int delta_code(              // 2-bit code of a delta (#bytes - 1)
+    u32   delta)                        // delta
+{
+    return (delta >= (1U << 8)) + (delta >= (1U << 16)) + (delta >= (1U << 24));
+}
+
+// -----------------------------------------------------------------------------
+inline int varint_size(             // number of bytes of a varint
+    u32   v)                            // value
+{
+    int size = 1;
+    while (v >= 0x80) { v >>= 7; ++size; }
+    return size;
+}
+
+// -----------------------------------------------------------------------------
+inline int read_varint(             // read a varint & advance the pointer
+    const u08 *&p)                      // pointer to bytes (return)
+{
+    u32 v = 0; int shift = 0;
+    while (*p & 0x80) { v |= (u32) (*p++ & 0x7F) << shift; shift += 7; }
+    v |= (u32) (*p++) << shift;
+    return (int) v;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+u64 packed_row_size(                // number of bytes of a packed row
+    int   len,                          // number of items
+    const DType *data)                  // sorted items
+{
+    u64 size = varint_size((u32) len) + (len + 3) / 4;
+    u32 prev = 0;
+    for (int j = 0; j < len; ++j) {
+        size += delta_code((u32) data[j] - prev) + 1; prev = (u32) data[j];
+    }
+    return size;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void pack_row(                      // pack a row of sorted items
+    int   len,                          // number of items
+    const DType *data,                  // sorted items
+    u08   *out)                         // packed row (return)
+{
+    u32 v = (u32) len;
+    while (v >= 0x80) { *out++ = (u08) (v | 0x80); v >>= 7; }
+    *out++ = (u08) v;
+    
+    u08 *ctrl = out;
+    u08 *bytes = out + (len + 3) / 4;
+    std::fill(ctrl, bytes, 0);
+    u32 prev = 0;
+    for (int j = 0; j < len; ++j) {
+        u32 delta = (u32) data[j] - prev; prev = (u32) data[j];
+        int code = delta_code(delta);
+        ctrl[j>>2] |= (u08) (code << ((j & 3) << 1));
+        for (int b = 0; b <= code; ++b) { *bytes++ = (u08) delta; delta >>= 8; }
+    }
+}
+
+// -----------------------------------------------------------------------------
+//  PackedData: a data set of packed rows, addressed by the byte offset of
+//  each block of PACK_BLOCK rows and the 32-bit offset of each row within
+//  its block (about 4 bytes per row rather than 8)
+// -----------------------------------------------------------------------------
+class PackedData {
+public:
+    PackedData();                   // constructor
+    
+    // -------------------------------------------------------------------------
+    ~PackedData();                  // destructor
+    
+    // -------------------------------------------------------------------------
+    template<class DType>
+    void pack(                      // pack a sparse data set
+        int   n,                        // number of data points
+        const DType *dataset,           // data set
+        const u64   *datapos);          // data position
+    
+    // -------------------------------------------------------------------------
+    void load(                      // load packed data from disk
+        int   n,                        // number of data points
+        const char *fname);             // address of packed data
+    
+    // -------------------------------------------------------------------------
+    void save(                      // save packed data to disk
+        const char *fname) const;       // address of packed data
+    
+    // -------------------------------------------------------------------------
+    inline const u08* row(          // get the packed bytes of a row
+        int   id) const                 // row id
+    {
+        return bytes_.data() + blockpos_[id / PACK_BLOCK] + rowoff_[id];
+    }
+    
+    // -------------------------------------------------------------------------
+    inline int length(              // get the number of items of a row
+        int   id) const                 // row id
+    {
+        const u08 *p = row(id);
+        return read_varint(p);
+    }
+    
+    // -------------------------------------------------------------------------
+    template<class DType>
+    inline int unpack(              // unpack a row into a buffer
+        int   id,                       // row id
+        DType *buf) const               // buffer of max_len() items (return)
+    {
+        const u08 *p = row(id);
+        int len = read_varint(p);
+        svb_decode(len, p, p + (len + 3) / 4, buf);
+        return len;
+    }
+    
+    // -------------------------------------------------------------------------
+    u64 num_bytes() const;          // number of bytes of rows & offsets
+    
+    // -------------------------------------------------------------------------
+    int size() const { return n_; } // number of data points
+    
+    // -------------------------------------------------------------------------
+    u64 num_coords() const { return N_; } // total number of coordinates
+    
+    // -------------------------------------------------------------------------
+    int max_len() const { return max_len_; } // max length of rows
+    
+    // -------------------------------------------------------------------------
+    int max_item() const { return max_item_; } // max item id
+
+protected:
+    int   n_;                       // number of data points
+    u64   N_;                       // total number of coordinates
+    int   max_len_;                 // max length of rows
+    int   max_item_;                // max item id
+    std::vector<u64> blockpos_;     // byte offset of each block of rows
+    std::vector<u32> rowoff_;       // byte offset of each row in its block
+    std::vector<u08> bytes_;        // packed rows (with PACK_PAD zero bytes)
+    
+    // -------------------------------------------------------------------------
+    void calc_max_len();            // calc max_len_ by the row lengths
+};
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void PackedData::pack(              // pack a sparse data set
+    int   n,                            // number of data points
+    const DType *dataset,               // data set
+    const u64   *datapos)               // data position
+{
+    n_ = n; N_ = datapos[n];
+    int n_blocks = (n + PACK_BLOCK - 1) / PACK_BLOCK;
+    
+    // get the bytes of each block & the offset of each row in its block, then
+    // prefix-sum the block sizes (only n/PACK_BLOCK items)
+    int max_item = 0;
+    blockpos_.assign(n_blocks+1, 0UL); rowoff_.resize(n);
+#pragma omp parallel for reduction(max:max_item)
+    for (int b = 0; b < n_blocks; ++b) {
+        int lo = b * PACK_BLOCK, hi = std::min(n, lo + PACK_BLOCK);
+        u64 size = 0UL;
+        for (int i = lo; i < hi; ++i) {
+            int len = get_length(i, datapos);
+            const DType *data = dataset + datapos[i];
+            
+            assert(size <= MAX_UINT32);
+            rowoff_[i] = (u32) size;
+            size += packed_row_size<DType>(len, data);
+            if (len > 0) max_item = std::max(max_item, (int) data[len-1]);
+        }
+        blockpos_[b+1] = size;
+    }
+    for (int b = 1; b <= n_blocks; ++b) blockpos_[b] += blockpos_[b-1];
+    max_item_ = max_item;
+    
+    // pack the rows in parallel
+    bytes_.assign(blockpos_[n_blocks] + PACK_PAD, 0);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        pack_row<DType>(get_length(i, datapos), dataset + datapos[i], 
+            bytes_.data() + blockpos_[i / PACK_BLOCK] + rowoff_[i]);
+    }
+    calc_max_len();
+}
+
+// -----------------------------------------------------------------------------
+//  SparseRows: the rows of a data set, either raw (dataset & datapos) or 
+//  packed; get() returns a raw row in place, and unpacks a packed row into 
+//  the buffer of the calling thread (buf_len() items) right before it is 
+//  used, so the kernels run the same code over both
+// -----------------------------------------------------------------------------
+template<class DType>
+class SparseRows {
+public:
+    SparseRows(                     // constructor (raw rows)
+        int   n,                        // number of data points
+        const DType *dataset,           // data set
+        const u64   *datapos)           // data position
+        : n_(n), dataset_(dataset), datapos_(datapos), packed_(nullptr) {}
+    
+    // -------------------------------------------------------------------------
+    SparseRows(                     // constructor (packed rows)
+        const PackedData *packed)       // packed data set
+        : n_(packed->size()), dataset_(nullptr), datapos_(nullptr), 
+        packed_(packed) {}
+    
+    // -------------------------------------------------------------------------
+    inline int length(              // get the number of items of a row
+        int   id) const                 // row id
+    {
+        return packed_ != nullptr ? packed_->length(id) : 
+            get_length(id, datapos_);
+    }
+    
+    // -------------------------------------------------------------------------
+    inline const DType* get(        // get a row
+        int   id,                       // row id
+        DType *buf,                     // buffer of buf_len() items
+        int   &len) const               // number of items (return)
+    {
+        if (packed_ != nullptr) {
+            len = packed_->unpack<DType>(id, buf);
+            return buf;
+        }
+        len = get_length(id, datapos_);
+        return dataset_ + datapos_[id];
+    }
+    
+    // -------------------------------------------------------------------------
+    int buf_len() const             // length of the buffer of get()
+    {
+        return packed_ != nullptr ? packed_->max_len() : 0;
+    }
+    
+    // -------------------------------------------------------------------------
+    u64 num_coords() const          // total number of coordinates
+    {
+        return packed_ != nullptr ? packed_->num_coords() : datapos_[n_];
+    }
+    
+    // -------------------------------------------------------------------------
+    int max_item() const            // max item id (a scan over raw rows)
+    {
+        if (packed_ != nullptr) return packed_->max_item();
+        
+        int max_item = 0;
+#pragma omp parallel for reduction(max:max_item)
+        for (u64 j = 0; j < datapos_[n_]; ++j) {
+            max_item = std::max(max_item, (int) dataset_[j]);
+        }
+        return max_item;
+    }
+    
+    // -------------------------------------------------------------------------
+    int size() const { return n_; } // number of data points
+    
+    // -------------------------------------------------------------------------
+    bool packed() const { return packed_ != nullptr; } // packed rows or not
+    
+    // -------------------------------------------------------------------------
+    const DType* dataset() const { return dataset_; } // nullptr if packed
+    
+    // -------------------------------------------------------------------------
+    const u64* datapos() const { return datapos_; } // nullptr if packed
+
+protected:
+    int   n_;                       // number of data points
+    const DType *dataset_;          // data set (raw rows)
+    const u64   *datapos_;          // data position (raw rows)
+    const PackedData *packed_;      // packed data set (packed rows)
+};
+
+} // end namespace clustering
@@ -2,33 +2,142 @@
 
 namespace clustering {
 
+// -----------------------------------------------------------------------------
+void weights_to_prob(               // init blocked prefix sum by weights
+    int   n,                            // number of data points
+    const int *weights,                 // weights of data set
+    float *prob,                        // prefix sum in each block (return)
+    double *block_sum)                  // prefix sum of block totals (return)
+{
+    int n_blocks = (n + SCAN_BLOCK - 1) / SCAN_BLOCK;
+#pragma omp parallel for
+    for (int b = 0; b < n_blocks; ++b) {
+        int lo = b * SCAN_BLOCK, hi = std::min(n, lo + SCAN_BLOCK);
+        double sum = 0.0;
+        for (int i = lo; i < hi; ++i) { sum += weights[i]; prob[i] = (float) sum; }
+        block_sum[b+1] = sum;
+    }
+    block_sum[0] = 0.0;
+    for (int b = 1; b <= n_blocks; ++b) block_sum[b] += block_sum[b-1];
+}
+
+// -----------------------------------------------------------------------------
+int sample_by_prob(                 // sample a data id by blocked prefix sum
+    int   n,                            // number of data points
+    const float  *prob,                 // prefix sum in each block
+    const double *block_sum)            // prefix sum of block totals
+{
+    int n_blocks = (n + SCAN_BLOCK - 1) / SCAN_BLOCK;
+    if (block_sum[n_blocks] <= 0.0) return rand() % n; // all prob are zero
+    
+    // binary search the block by the block totals (in double), then search
+    // inside this block by its local prefix sum; upper_bound skips the data
+    // (and blocks) whose prob is zero
+    double val = uniform(0.0, block_sum[n_blocks]);
+    int b = std::upper_bound(block_sum, block_sum+n_blocks+1, val) - block_sum;
+    b = std::min(std::max(b-1, 0), n_blocks-1);
+    
+    int   lo = b * SCAN_BLOCK, hi = std::min(n, lo + SCAN_BLOCK);
+    float local = (float) (val - block_sum[b]);
+    int   id = std::upper_bound(prob+lo, prob+hi, local) - prob;
+    if (id < hi) return id;
+    
+    // local may be rounded up to the block total in float; then step back to
+    // the last data with non-zero prob, as the tail (e.g., a chosen seed) has
+    // zero prob and must not be sampled again
+    id = hi - 1;
+    while (id > lo && prob[id] <= prob[id-1]) --id;
+    return id;
+}
+
+// -----------------------------------------------------------------------------
+double calc_seeding_cost(           // calc the weighted D^2 cost
+    int   n,                            // number of data points
+    const int   *weights,               // weights of data set
+    const float *nn_dist)               // nn_dist
+{
+    double cost = 0.0;
+#pragma omp parallel for reduction(+:cost)
+    for (int i = 0; i < n; ++i) cost += (double) weights[i] * SQR(nn_dist[i]);
+    
+    return cost;
+}
+
+// -----------------------------------------------------------------------------
+void sort_seeds_by_length(          // sort seed ids by seed length
+    int   k,                            // number of seeds
+    const u64 *seedpos,                 // seed position
+    int   *order,                       // seed ids sorted by length (return)
+    int   *lens)                        // sorted seed lengths (return)
+{
+    std::iota(order, order+k, 0);
+    std::stable_sort(order, order+k, [&](int i, int j) {
+        return get_length(i, seedpos) < get_length(j, seedpos); });
+    
+    for (int i = 0; i < k; ++i) lens[i] = get_length(order[i], seedpos);
+}
+
+// -----------------------------------------------------------------------------
+int nonempty_labels(                // get the non-empty labels in asc. order
+    int n,                              // number of data points
+    int k,                              // number of cluster centers
+    const int *labels,                  // cluster labels for data
+    std::vector<int> &ids)              // non-empty labels (return)
+{
+    std::vector<bool> used(k, false);
+    for (int i = 0; i < n; ++i) used[labels[i]] = true;
+    
+    ids.clear();
+    for (int j = 0; j < k; ++j) if (used[j]) ids.push_back(j);
+    
+    return (int) ids.size();
+}
+
 // -----------------------------------------------------------------------------
 u64 labels_to_index(                // convert labels into index and index_pos
     int n,                              // number of labels
     int k,                              // number of centers
-    int *labels,                        // data labels (allow modify)
+    int *labels,                        // data labels (re-numbered on return)
     std::vector<int> &binset,           // bin set (return)
     std::vector<u64> &binpos)           // bin position (return)
 {
-    // sort all labels and its corresponding index
-    int *index = new int[n];
-    int i = 0;
-    std::iota(index, index+n, i++);
-    std::sort(index, index+n, [&](int i,int j){return labels[i] < labels[j];});
-    std::sort(labels, labels+n);
-    
-    // update binset and binpos
-    binset.reserve(n);
-    binset.insert(binset.end(), index, index+n);
+    // parallel counting sort: each thread counts the labels of its static 
+    // chunk, the histograms are prefix-summed in (label, thread) order, and 
+    // each thread scatters its ids into its own slots, so the ids in a bin 
+    // are in ascending order; empty bins are skipped, and the labels are 
+    // re-numbered to the ids of non-empty bins in the scatter pass
+    int n_threads = omp_get_max_threads();
+    std::vector<u64> hist((u64) n_threads*k, 0UL);
+    std::vector<int> new_id(k, -1);
     
+    binset.resize(n);
     binpos.reserve(k+1); // reserve by the last number of centers
     binpos.push_back(0UL);
-    for (int i = 1; i < n; ++i) {
-        if (labels[i] != labels[i-1]) binpos.push_back(i);
-    }
-    binpos.push_back(n);
+#pragma omp parallel
+{
+    u64 *my_hist = hist.data() + (u64) omp_get_thread_num()*k;
+#pragma omp for schedule(static)
+    for (int i = 0; i < n; ++i) ++my_hist[labels[i]];
     
-    delete[] index;
+#pragma omp single
+    {
+        u64 sum = 0UL;
+        for (int j = 0; j < k; ++j) {
+            for (int t = 0; t < n_threads; ++t) {
+                u64 &h = hist[(u64) t*k+j];
+                u64 cnt = h; h = sum; sum += cnt;
+            }
+            if (sum > binpos.back()) {
+                new_id[j] = (int) binpos.size()-1; binpos.push_back(sum);
+            }
+        }
+    }
+#pragma omp for schedule(static)
+    for (int i = 0; i < n; ++i) {
+        int label = labels[i];
+        binset[my_hist[label]++] = i; labels[i] = new_id[label];
+    }
+}
     return binpos.size()-1;
 }
 
@@ -43,18 +152,11 @@ int labels_to_bins(                 // labels to bins & re-number labels
     std::vector<int>().swap(binset);
     std::vector<u64>().swap(binpos);
     
-    // convert labels on local data into global bin set and bin position
+    // convert labels on local data into global bin set and bin position, 
+    // and re-number labels for local data in the same pass
     u64 num_bins = labels_to_index(n, k, labels, binset, binpos);
     assert(num_bins <= k && num_bins > 0);
     
-    // re-number labels for local data
-    int id = -1, num = -1;
-    for (int i = 0; i < num_bins; ++i) {
-        const int *bin = &binset[binpos[i]];    // get bin
-        num = int(binpos[i+1] - binpos[i]); // get bin num
-        
-        for (int j = 0; j < num; ++j) { id = bin[j]; labels[id] = i; }
-    }
     return num_bins;
 }
 
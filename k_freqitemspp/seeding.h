@@ -12,6 +12,8 @@
 
 #include "def.h"
 #include "util.h"
+#include "counter.h"
+#include "packed.h"
 
 namespace clustering {
 
@@ -21,14 +23,14 @@ void update_nn_dist(                // update nn_dist for input data
     int   did,                          // input data id
     int   s_len,                        // length of last seed
     const DType *seed,                  // input seed
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
+    const SparseRows<DType> &rows,      // data set
+    DType *buf,                         // buffer of rows (thread-local)
     float &nn_dist)                     // nn_dist (return)
 {
-    int   d_len = get_length(did, datapos);
-    const DType *data = dataset + datapos[did];
+    int   d_len = 0;
+    const DType *data = rows.get(did, buf, d_len);
     
-    float dist = jaccard_dist2<DType>(d_len, s_len, data, seed);
+    float dist = jaccard_dist<DType>(d_len, s_len, data, seed);
     if (nn_dist > dist) nn_dist = dist;
 }
 
@@ -37,28 +39,53 @@ template<class DType>
 void update_dist_and_prob(          // update nn_dist and prob by last seed
     int   n,                            // number of data points
     int   id,                           // last seed id
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
+    const SparseRows<DType> &rows,      // data set
     const int   *weights,               // weights of data set
     float *nn_dist,                     // nn_dist (return)
-    float *prob)                        // probability (return)
+    float *prob,                        // prefix sum in each block (return)
+    double *block_sum)                  // prefix sum of block totals (return)
 {
     // get last seed
-    int   s_len = get_length(id, datapos);
-    const DType *seed = dataset + datapos[id];
-    
-    // update nn_dist for the local data (use OpenMP by default)
-#pragma omp parallel for
-    for (int i = 0; i < n; ++i) {
-        update_nn_dist<DType>(i, s_len, seed, dataset, datapos, nn_dist[i]);
-    }
+    int   s_len = 0;
+    std::vector<DType> seed_buf(rows.buf_len());
+    const DType *seed = rows.get(id, seed_buf.data(), s_len);
     
-    // update the probability array
-    prob[0] = weights[0] * SQR(nn_dist[0]);
-    for (int i = 1; i < n; ++i) {
-        prob[i] = prob[i-1] + weights[i] * SQR(nn_dist[i]);
+    // update nn_dist and the prefix sum inside each block of SCAN_BLOCK data
+    // in parallel; the sum is accumulated in double and stored relative to 
+    // the block start, so no increment vanishes into a huge float sum
+    int n_blocks = (n + SCAN_BLOCK - 1) / SCAN_BLOCK;
+#pragma omp parallel
+{
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+#pragma omp for schedule(dynamic)
+    for (int b = 0; b < n_blocks; ++b) {
+        int lo = b * SCAN_BLOCK, hi = std::min(n, lo + SCAN_BLOCK);
+        double sum = 0.0;
+        for (int i = lo; i < hi; ++i) {
+            update_nn_dist<DType>(i, s_len, seed, rows, buf.data(), nn_dist[i]);
+            sum += weights[i] * SQR((double) nn_dist[i]);
+            prob[i] = (float) sum;
+        }
+        block_sum[b+1] = sum;
     }
 }
+    // prefix sum of block totals (only n/SCAN_BLOCK items)
+    block_sum[0] = 0.0;
+    for (int b = 1; b <= n_blocks; ++b) block_sum[b] += block_sum[b-1];
+}
+
+// -----------------------------------------------------------------------------
+void weights_to_prob(               // init blocked prefix sum by weights
+    int   n,                            // number of data points
+    const int *weights,                 // weights of data set
+    float *prob,                        // prefix sum in each block (return)
+    double *block_sum);                 // prefix sum of block totals (return)
+
+// -----------------------------------------------------------------------------
+int sample_by_prob(                 // sample a data id by blocked prefix sum
+    int   n,                            // number of data points
+    const float  *prob,                 // prefix sum in each block
+    const double *block_sum);           // prefix sum of block totals
 
 // -----------------------------------------------------------------------------
 template<class DType>
@@ -66,12 +93,11 @@ void get_k_seeds(                   // get k seeds based on distinct ids
     int   n,                            // number of data points
     int   k,                            // number of seeds
     const int   *distinct_ids,          // k distinct ids
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
-    std::vector<int> &seedset,          // seed set (return)
+    const SparseRows<DType> &rows,      // data set
+    std::vector<DType> &seedset,        // seed set (return)
     std::vector<u64> &seedpos)          // seed position (return)
 {
-    std::vector<int>().swap(seedset);
+    std::vector<DType>().swap(seedset);
     std::vector<u64>().swap(seedpos);
     
     // init seedpos (sequential, cannot parallel)
@@ -79,21 +105,20 @@ void get_k_seeds(                   // get k seeds based on distinct ids
     seedpos.resize(k+1); seedpos[0] = 0;
     for (int i = 0; i < k; ++i) {
         id  = distinct_ids[i];          // get data id
-        len = get_length(id, datapos);  // get the length of data
-        const DType *data = dataset + datapos[id]; // get data 
+        len = rows.length(id);          // get the length of data
         
         seedpos[i+1] = seedpos[i] + len;
     }
     
     // get k seeds from dataset
+    std::vector<DType> buf(rows.buf_len());
     seedset.resize(seedpos[k]);
     for (int i = 0; i < k; ++i) {
         id  = distinct_ids[i];          // get data id
-        len = get_length(id, datapos);  // get the length of data
-        const DType *data = dataset + datapos[id]; // get data 
+        const DType *data = rows.get(id, buf.data(), len); // get data 
         
         // add this data into seedset
-        int *seed = seedset.data() + seedpos[i];
+        DType *seed = seedset.data() + seedpos[i];
         std::copy(data, data+len, seed);
     }
 }
@@ -103,11 +128,10 @@ template<class DType>
 void kmeanspp_seeding(              // init k centers by k-means++
     int   n,                            // number of data points
     int   k,                            // number of seeds
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
+    const SparseRows<DType> &rows,      // data set
     const int   *weights,               // weights of data set
     int   *distinct_ids,                // k distinct ids (return)
-    std::vector<int> &seedset,          // seed set (return)
+    std::vector<DType> &seedset,        // seed set (return)
     std::vector<u64> &seedpos)          // seed position (return)
 {
     srand(RANDOM_SEED); // fix a random seed
@@ -118,15 +142,14 @@ void kmeanspp_seeding(              // init k centers by k-means++
     float *nn_dist = new float[n];
     for (int i = 0; i < n; ++i) nn_dist[i] = MAX_FLOAT;
         
-    float *prob = new float[n];
-    prob[0] = (float) weights[0];
-    for (int i = 1; i < n; ++i) prob[i] = prob[i-1] + weights[i];
+    float  *prob = new float[n];
+    double *block_sum = new double[(n+SCAN_BLOCK-1)/SCAN_BLOCK + 1];
+    weights_to_prob(n, weights, prob, block_sum);
     
     // -------------------------------------------------------------------------
     //  sample the first center uniformly at random
     // -------------------------------------------------------------------------
-    float val = uniform(0.0f, prob[n-1]);
-    int   id  = std::lower_bound(prob, prob+n, val) - prob;
+    int id = sample_by_prob(n, prob, block_sum);
     distinct_ids[0] = id;
     
     // -------------------------------------------------------------------------
@@ -134,11 +157,11 @@ void kmeanspp_seeding(              // init k centers by k-means++
     // -------------------------------------------------------------------------
     for (int i = 1; i < k; ++i) {
         // update nn_dist and prob by last_seed
-        update_dist_and_prob<DType>(n, id, dataset, datapos, weights, nn_dist, prob);
+        update_dist_and_prob<DType>(n, id, rows, weights, nn_dist, prob, 
+            block_sum);
         
         // sample the i-th center (id) by D^2 sampling
-        val = uniform(0.0f, prob[n-1]);
-        id  = std::lower_bound(prob, prob+n, val) - prob;
+        id = sample_by_prob(n, prob, block_sum);
         distinct_ids[i] = id;
         
 #ifdef DEBUG_INFO
@@ -148,231 +171,1692 @@ void kmeanspp_seeding(              // init k centers by k-means++
     // -------------------------------------------------------------------------
     //  get the global seedset and seedpos by the k distinct ids
     // -------------------------------------------------------------------------
-    get_k_seeds<DType>(n, k, distinct_ids, dataset, datapos, seedset, seedpos);
+    get_k_seeds<DType>(n, k, distinct_ids, rows, seedset, seedpos);
 
     // release space
     delete[] nn_dist;
     delete[] prob;
+    delete[] block_sum;
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-int get_label(                      // get label (0,k-1) for input data
-    int   k,                            // number of seeds
-    int   n_data,                       // length of input data
-    const DType *data,                  // input data
-    const int   *seedset,               // seed set
-    const u64   *seedpos)               // seed position
+void gather_data(                   // gather data by ids into a compact set
+    int   m,                            // number of ids
+    const int   *ids,                   // data ids
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    std::vector<DType> &subset,         // data subset (return)
+    std::vector<u64>   &subpos)         // data subset position (return)
 {
-    int   label = 0;
-    float nn_dist = -1.0f;
+    subpos.resize(m+1); subpos[0] = 0;
+    for (int j = 0; j < m; ++j) subpos[j+1] = subpos[j] + get_length(ids[j], datapos);
     
-    for (int i = 0; i < k; ++i) {
-        int n_seed = get_length(i, seedpos);
-        const int *seed = seedset + seedpos[i];
-        
-        float dist = jaccard_dist<DType>(n_data, n_seed, data, seed);
-        if (nn_dist < 0 || dist < nn_dist) { nn_dist = dist; label = i; }
+    subset.resize(subpos[m]);
+#pragma omp parallel for
+    for (int j = 0; j < m; ++j) {
+        const DType *data = dataset + datapos[ids[j]];
+        std::copy(data, data+get_length(j, subpos.data()), 
+            subset.data() + subpos[j]);
     }
-    return label;
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-void exact_assign_data(             // exact sparse data assginment
+void keep_assigned_seeds(           // keep the seeds of the assignment as best
+    int   K,                            // number of non-empty clusters
+    const int   *old_ids,               // old label of each non-empty cluster
+    const DType *seedset,               // seed set of the assignment
+    const u64   *seedpos,               // seed position of the assignment
+    std::vector<DType> &best_seedset,   // best seed set (return)
+    std::vector<u64>   &best_seedpos)   // best seed position (return)
+{
+    // the stat of an assignment is the stat of the new labels (re-numbered in
+    // [0,K-1]) with the seeds they were assigned to, so the best clustering 
+    // keeps the seeds of the non-empty clusters in this order
+    gather_data<DType>(K, old_ids, seedset, seedpos, best_seedset, 
+        best_seedpos);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int dedup_data(                     // collapse duplicate rows into weights
     int   n,                            // number of data points
-    int   k,                            // number of seeds
     const DType *dataset,               // data set
     const u64   *datapos,               // data position
-    const int   *seedset,               // seed set
-    const u64   *seedpos,               // seed position
-    int   *labels)                      // cluster labels for dataset (return)
+    std::vector<int> &uniq_ids,         // data id of each unique row (return)
+    std::vector<int> &counts,           // #copies of each unique row (return)
+    std::vector<int> &row_to_uniq)      // unique row id of each row (return)
 {
+    // hash each row by its length and items
+    std::vector<std::pair<u64,int> > keys(n);
 #pragma omp parallel for
     for (int i = 0; i < n; ++i) {
-        int n_data = get_length(i, datapos);
+        int len = get_length(i, datapos);
         const DType *data = dataset + datapos[i];
         
-        labels[i] = get_label<DType>(k, n_data, data, seedset, seedpos);
+        u64 h = mix64((u64) len + 1);
+        for (int j = 0; j < len; ++j) h = mix64(h ^ (u64) data[j]);
+        keys[i] = std::make_pair(h, i);
+    }
+    // rows with the same hash are contiguous (in ascending order of ids)
+    std::sort(keys.begin(), keys.end());
+    
+    // find the first row (representative) of each group of duplicates; rows 
+    // in a run of equal hashes are compared item by item for collisions
+    row_to_uniq.resize(n);
+    for (int s = 0, e = 0; s < n; s = e) {
+        while (e < n && keys[e].first == keys[s].first) ++e;
+        for (int a = s; a < e; ++a) {
+            int i = keys[a].second, len = get_length(i, datapos);
+            const DType *data = dataset + datapos[i];
+            
+            row_to_uniq[i] = i;
+            for (int b = s; b < a; ++b) {
+                int j = keys[b].second;
+                if (row_to_uniq[j] != j || get_length(j, datapos) != len) continue;
+                if (std::equal(data, data+len, dataset + datapos[j])) {
+                    row_to_uniq[i] = j; break;
+                }
+            }
+        }
+    }
+    std::vector<std::pair<u64,int> >().swap(keys);
+    
+    // number the unique rows in ascending order of ids (representatives come
+    // before their duplicates), then map each row to its unique row
+    uniq_ids.clear(); counts.clear();
+    for (int i = 0; i < n; ++i) {
+        int j = row_to_uniq[i];
+        if (j == i) {
+            row_to_uniq[i] = (int) uniq_ids.size();
+            uniq_ids.push_back(i); counts.push_back(0);
+        }
+        else row_to_uniq[i] = row_to_uniq[j];
+        ++counts[row_to_uniq[i]];
     }
+    return (int) uniq_ids.size();
 }
 
 // -----------------------------------------------------------------------------
-u64 labels_to_index(                // convert labels into index and index_pos
-    int   n,                            // number of labels
-    int   k,                            // number of centers
-    const int *labels,                  // cluster labels for data points
-    std::vector<int> &binset,           // bin set (return)
-    std::vector<u64> &binpos);          // bin position (return)
+template<class DType>
+void update_dist_by_seeds(          // update nn_dist & nn_id by new seeds
+    int   n,                            // number of data points
+    int   m,                            // number of new seeds
+    int   base,                         // candidate id of the first new seed
+    const int   *ids,                   // data ids of new seeds
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    float *nn_dist,                     // nn_dist (return)
+    int   *nn_id)                       // candidate id of nn seed (return)
+{
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; ++i) {
+        int   d_len = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        for (int j = 0; j < m; ++j) {
+            int   s_len = get_length(ids[j], datapos);
+            const DType *seed = dataset + datapos[ids[j]];
+            
+            float dist = jaccard_dist<DType>(d_len, s_len, data, seed);
+            if (dist < nn_dist[i]) { nn_dist[i] = dist; nn_id[i] = base + j; }
+        }
+    }
+}
 
 // -----------------------------------------------------------------------------
-int labels_to_bins(                 // labels to bins & re-number labels
-    int n,                              // number of data points
-    int k,                              // number of centers
-    int *labels,                        // cluster labels for data (return)
-    std::vector<int> &binset,           // bin set (return)
-    std::vector<u64> &binpos);          // bin position (return)
+double calc_seeding_cost(           // calc the weighted D^2 cost
+    int   n,                            // number of data points
+    const int   *weights,               // weights of data set
+    const float *nn_dist);              // nn_dist
 
 // -----------------------------------------------------------------------------
 template<class DType>
-int frequent_items(                 // find frequent items as a seed
-    int   num,                          // number of point IDs in a bin
-    int   max_len,                      // max length for a seed
-    float alpha,                        // global \alpha \in (0,1)
-    const int   *bin,                   // bin
+void kmeansll_seeding(              // init k centers by k-means||
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    int   n_rounds,                     // number of rounds (0: ceil(ln(cost)))
     const DType *dataset,               // data set
     const u64   *datapos,               // data position
-    DType *seed)                        // a seed (return)
+    const int   *weights,               // weights of data set
+    int   *distinct_ids,                // k distinct ids (return)
+    std::vector<DType> &seedset,        // seed set (return)
+    std::vector<u64> &seedpos)          // seed position (return)
 {
-    // deal with the special case with a single data
-    if (num == 1) {
-        int   id = bin[0];
-        const DType *data = dataset + datapos[id]; // get data
-        int   len = get_length(id, datapos);       // get data len
+    srand(RANDOM_SEED); // fix a random seed
+    
+    // -------------------------------------------------------------------------
+    //  sample the first candidate by weights (the same as k-means++)
+    // -------------------------------------------------------------------------
+    std::vector<float>  prob(n);
+    std::vector<double> block_sum((n+SCAN_BLOCK-1)/SCAN_BLOCK + 1);
+    weights_to_prob(n, weights, prob.data(), block_sum.data());
+    
+    int id = sample_by_prob(n, prob.data(), block_sum.data());
+    std::vector<float>().swap(prob);
+    std::vector<double>().swap(block_sum);
+    
+    std::vector<int> cand_ids(1, id); // data ids of candidates
+    float *nn_dist = new float[n];
+    int   *nn_id   = new int[n];
+    std::fill(nn_dist, nn_dist+n, MAX_FLOAT);
+    update_dist_by_seeds<DType>(n, 1, 0, &id, dataset, datapos, nn_dist, nn_id);
+    
+    double cost = calc_seeding_cost(n, weights, nn_dist);
+    if (n_rounds <= 0) n_rounds = std::max(1, (int) ceil(log(cost)));
+    
+    // -------------------------------------------------------------------------
+    //  oversample about l = OVERSAMPLE*k candidates in each round, where each 
+    //  data is sampled independently with prob min(1, l*w*D^2/cost)
+    // -------------------------------------------------------------------------
+    double l = (double) OVERSAMPLE * k;
+    for (int r = 1; r <= n_rounds && cost > 0; ++r) {
+        std::vector<int> new_ids;
+#pragma omp parallel
+{
+        std::vector<int> local_ids; // thread-local samples
+#pragma omp for nowait
+        for (int i = 0; i < n; ++i) {
+            double p = l * weights[i] * SQR(nn_dist[i]) / cost;
+            if (hash_uniform((u64) RANDOM_SEED << 32 | r, i) < p) {
+                local_ids.push_back(i);
+            }
+        }
+#pragma omp critical
+        new_ids.insert(new_ids.end(), local_ids.begin(), local_ids.end());
+}
+        std::sort(new_ids.begin(), new_ids.end()); // independent of #threads
         
-        len = std::min(max_len, len);
-        std::copy(data, data+len, seed);
-        return len;
+        int m = (int) new_ids.size();
+        update_dist_by_seeds<DType>(n, m, (int) cand_ids.size(), 
+            new_ids.data(), dataset, datapos, nn_dist, nn_id);
+        cand_ids.insert(cand_ids.end(), new_ids.begin(), new_ids.end());
+        cost = calc_seeding_cost(n, weights, nn_dist);
+        
+#ifdef DEBUG_INFO
+        printf("k-FreqItems|| Seeding: round %d/%d, %d candidates, cost=%g\n", 
+            r, n_rounds, (int) cand_ids.size(), cost);
+#endif
     }
+    delete[] nn_dist;
     
-    // consider the case with multiple data
-    // get the total number of coordinates in this bin
-    u64 tot_num = 0UL;
-    for (int i = 0; i < num; ++i) {
-        int id = bin[i]; tot_num += get_length(id, datapos);
+    int m = (int) cand_ids.size();
+    if (m < k) { // too few candidates (e.g., many duplicates), use k-means++
+        delete[] nn_id;
+        kmeanspp_seeding<DType>(n, k, SparseRows<DType>(n, dataset, datapos), 
+            weights, distinct_ids, seedset, seedpos);
+        return;
     }
     
-    // init an array to store all coordinates sequentially
-    DType *arr = new DType[tot_num];
-    int len = 0; 
-    u64 cnt = 0UL;
-    for (int i = 0; i < num; ++i) {
-        int   id = bin[i];
-        const DType *data = dataset + datapos[id]; // get data
-        len = get_length(id, datapos);         // get data len
-        
-        // copy the coordinates of this data to the array
-        std::copy(data, data+len, arr+cnt);
-        cnt += len;
-    }
-    assert(cnt == tot_num);
+    // -------------------------------------------------------------------------
+    //  weight each candidate by the total weight of data closest to it
+    // -------------------------------------------------------------------------
+    std::vector<int> cand_weights(m, 0);
+#pragma omp parallel
+{
+    std::vector<int> local_weights(m, 0); // thread-local weights
+#pragma omp for nowait
+    for (int i = 0; i < n; ++i) local_weights[nn_id[i]] += weights[i];
+    
+#pragma omp critical
+    for (int j = 0; j < m; ++j) cand_weights[j] += local_weights[j];
+}
+    delete[] nn_id;
+    
+    // -------------------------------------------------------------------------
+    //  reduce the weighted candidates to k seeds by weighted k-means++
+    // -------------------------------------------------------------------------
+    std::vector<DType> cand_set;
+    std::vector<u64>   cand_pos;
+    gather_data<DType>(m, cand_ids.data(), dataset, datapos, cand_set, cand_pos);
     
-    // get the distinct coordinates and their frequencies
-    DType *coord = new DType[tot_num];
-    int   *freq  = new int[tot_num];
-    int n = 0; // number of distinct coordinates
-    int max_freq = distinct_coord_and_freq<DType>(tot_num, arr, coord, freq, n);
+    kmeanspp_seeding<DType>(m, k, SparseRows<DType>(m, cand_set.data(), 
+        cand_pos.data()), cand_weights.data(), distinct_ids, seedset, seedpos);
+    for (int i = 0; i < k; ++i) distinct_ids[i] = cand_ids[distinct_ids[i]];
+}
 
-    // sequentially get the high frequent coordinates as seed 
-    int threshold = (int) ceil((double) max_freq*alpha);
-    len = 0; // number of coordinates for seed
-    for (int i = 0; i < n; ++i) {
-        if (freq[i] >= threshold) {
-            seed[len++] = coord[i];
-            if (len >= max_len) break;
-        }
+// -----------------------------------------------------------------------------
+template<class DType>
+float seed_jaccard_dist(            // calc jaccard dist between data & seed
+    int   n_data,                       // length of input data
+    int   sid,                          // seed id
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos)                // bit position (nullptr: no bitmaps)
+{
+    int n_seed = get_length(sid, seedpos);
+    const DType *seed = seedset + seedpos[sid];
+    
+    // use the bitmap of this seed if it has one, i.e., long seeds
+    if (bitpos != nullptr && bitpos[sid+1] > bitpos[sid]) {
+        int n_words = (int) (bitpos[sid+1] - bitpos[sid]);
+        return bitmap_jaccard_dist<DType>(n_data, n_seed, n_words, seed[0], 
+            data, bitset + bitpos[sid]);
     }
-    // release space
-    delete[] arr; delete[] coord; delete[] freq;
+    return jaccard_dist<DType>(n_data, n_seed, data, seed);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int get_nn_label(                   // get label (0,k-1) & nn dist for data
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    float &nn_dist)                     // dist to the nearest seed (return)
+{
+    int label = 0;
+    nn_dist = -1.0f;
     
-    return len;
+    for (int i = 0; i < k; ++i) {
+        float dist = seed_jaccard_dist<DType>(n_data, i, data, seedset, 
+            seedpos, bitset, bitpos);
+        if (nn_dist < 0 || dist < nn_dist) { nn_dist = dist; label = i; }
+    }
+    return label;
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-void bins_to_seeds(                 // convert bins into seeds
+int get_label(                      // get label (0,k-1) for input data
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos)                // bit position (nullptr: no bitmaps)
+{
+    float nn_dist = -1.0f;
+    return get_nn_label<DType>(k, n_data, data, seedset, seedpos, bitset, 
+        bitpos, nn_dist);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int exact_assign_data(              // exact sparse data assginment
     int   n,                            // number of data points
-    int   k,                            // number of bins (and seeds)
-    int   avg_d,                        // average dimension of data points
-    float alpha,                        // \alpha \in (0,1)
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
-    const int   *binset,                // bin set
-    const u64   *binpos,                // bin position
-    std::vector<int> &seedset,          // seed set (return)
-    std::vector<u64> &seedpos)          // seed position (return)
+    int   k,                            // number of seeds
+    const SparseRows<DType> &rows,      // data set
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *weights,               // weights of data set (nullptr: 1)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    double *stat)                       // sum of w, w*dist, w*dist^2 (return,
+                                        // nullptr: not needed)
 {
-    // clear seedset and seedpos
-    std::vector<int>().swap(seedset);
-    std::vector<u64>().swap(seedpos);
+    int n_changed = 0; // number of labels changed since last iteration
+    double sum_w = 0.0, sum_d = 0.0, sum_d2 = 0.0;
+#pragma omp parallel reduction(+:n_changed,sum_w,sum_d,sum_d2)
+{
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+#pragma omp for
+    for (int i = 0; i < n; ++i) {
+        int   n_data = 0;
+        const DType *data = rows.get(i, buf.data(), n_data);
+        
+        float nn_dist = -1.0f;
+        int label = get_nn_label<DType>(k, n_data, data, seedset, seedpos, 
+            bitset, bitpos, nn_dist);
+        n_changed += (label != last_labels[i]); labels[i] = label;
+        
+        double w = weights != nullptr ? weights[i] : 1.0;
+        sum_w += w; sum_d += w * nn_dist; sum_d2 += w * SQR(nn_dist);
+    }
+}
+    if (stat != nullptr) { stat[0] = sum_w; stat[1] = sum_d; stat[2] = sum_d2; }
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int build_seed_index(               // build inverted index (item -> seed ids)
+    int   k,                            // number of seeds
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    std::vector<int> &postset,          // posting set (return)
+    std::vector<u64> &postpos)          // posting position (return)
+{
+    std::vector<int>().swap(postset);
+    std::vector<u64>().swap(postpos);
     
-    // determine k seeds
-    int max_len = 100*avg_d; // TODO: the factor 100 can be tuned
-    DType *seeds = new DType[(u64)k*max_len];
-    seedpos.resize(k+1); seedpos[0] = 0;
-#pragma omp parallel for
+    // get the max item id (each seed is sorted in ascending order)
+    int max_item = -1;
     for (int i = 0; i < k; ++i) {
-        const int *bin = binset + binpos[i];  // get a bin
-        int num = get_length(i, binpos); // get # point ID's in a bin
-        
-        seedpos[i+1] = frequent_items<DType>(num, max_len, alpha, bin, 
-            dataset, datapos, seeds+i*max_len);
+        if (seedpos[i+1] > seedpos[i]) {
+            max_item = std::max(max_item, (int) seedset[seedpos[i+1]-1]);
+        }
     }
     
-    // determine seedpos by accumulating the size of each seed
-    for (int i = 1; i <= k; ++i) seedpos[i] += seedpos[i-1];
+    // count the number of seeds containing each item
+    postpos.resize(max_item+2, 0UL);
+    for (u64 j = 0; j < seedpos[k]; ++j) ++postpos[seedset[j]+1];
+    for (int i = 1; i <= max_item+1; ++i) postpos[i] += postpos[i-1];
     
-    // convert seeds into seedset
-    seedset.resize(seedpos[k]);
-    int *seedset_ptr = seedset.data();
-#pragma omp parallel for
+    // fill in the posting lists (seed ids are in ascending order per item)
+    std::vector<u64> cnt(postpos.begin(), postpos.end()-1);
+    postset.resize(seedpos[k]);
     for (int i = 0; i < k; ++i) {
-        int num = seedpos[i+1] - seedpos[i];
-        DType *seed = seeds + (u64) i*max_len;
-        std::copy(seed, seed+num, seedset_ptr+seedpos[i]);
+        for (u64 j = seedpos[i]; j < seedpos[i+1]; ++j) {
+            postset[cnt[seedset[j]]++] = i;
+        }
     }
-    delete[] seeds;
+    return max_item;
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-float calc_jaccard_dist(            // calc jaccard dist between data & seed
-    int   did,                          // data id
-    int   sid,                          // label (seed id)
-    const DType *dataset,               // data set
-    const u64   *datapos,               // data position
-    const int   *seedset,               // seed set
-    const u64   *seedpos)               // seed position
+int index_get_label(                // get label (0,k-1) by inverted index
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    int   max_item,                     // max item id in the inverted index
+    const DType *data,                  // input data
+    const u64   *seedpos,               // seed position
+    const int   *postset,               // posting set
+    const u64   *postpos,               // posting position
+    int   *overlap,                     // overlap counters, all 0 (allow modify)
+    int   *touched)                     // touched seed ids (allow modify)
 {
-    int n_data = get_length(did, datapos);
-    const DType *data = dataset + datapos[did];
+    // collect the overlap of data with each seed sharing at least one item
+    int n_touched = 0;
+    for (int j = 0; j < n_data; ++j) {
+        int item = (int) data[j];
+        if (item > max_item) break; // data is sorted in ascending order
+        
+        for (u64 p = postpos[item]; p < postpos[item+1]; ++p) {
+            int sid = postset[p];
+            if (overlap[sid]++ == 0) touched[n_touched++] = sid;
+        }
+    }
     
-    int n_seed = get_length(sid, seedpos);
-    const int *seed = seedset + seedpos[sid];
+    // the first seed without overlap has the same distance as all the others
+    // (i.e., 1.0f), so it is the only one that should be checked
+    int   label = 0;
+    while (label < k && overlap[label] > 0) ++label;
+    float nn_dist = 1.0f;
+    if (label == k) { label = -1; nn_dist = MAX_FLOAT; }
     
-    return jaccard_dist<DType>(n_data, n_seed, data, seed);
+    // derive the exact jaccard distance from |data|, |seed|, and overlap; ties
+    // are broken by the smaller seed id, which is consistent with get_label
+    for (int j = 0; j < n_touched; ++j) {
+        int sid = touched[j], cnt = overlap[sid];
+        int n_seed = get_length(sid, seedpos);
+        
+        float dist = 1.0f - (float) cnt / (n_data + n_seed - cnt);
+        if (dist < nn_dist || (dist == nn_dist && sid < label)) {
+            nn_dist = dist; label = sid;
+        }
+        overlap[sid] = 0; // reset overlap counter for the next data
+    }
+    return label;
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-void calc_stat_by_seeds(            // calc statistics by seeds
+int index_assign_data(              // sparse data assignment by inverted index
     int   n,                            // number of data points
-    int   k,                            // number of clusters
-    const int   *labels,                // cluster labels for data points
+    int   k,                            // number of seeds
     const DType *dataset,               // data set
     const u64   *datapos,               // data position
-    const int   *seedset,               // seed set
+    const DType *seedset,               // seed set
     const u64   *seedpos,               // seed position
-    float &mae,                         // mean absolute error (return)
-    float &mse)                         // mean square   error (return)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels)                      // cluster labels for dataset (return)
 {
-    // calc the jaccard distance for local data to its nearest seed
-    float *dist = new float[n];
-#pragma omp parallel for
-    for (int i = 0; i < n; ++i) {
-        dist[i] = calc_jaccard_dist<DType>(i, labels[i], dataset, datapos, 
-            seedset, seedpos);
-    }
+    // build the inverted index of seeds for this iteration
+    std::vector<int> postset;
+    std::vector<u64> postpos;
+    int max_item = build_seed_index(k, seedset, seedpos, postset, postpos);
     
-    // sequentially calc mae and mse for clusters
-    mae = 0.0f; mse = 0.0f;
-    float dis = -1.0f;
+    int n_changed = 0; // number of labels changed since last iteration
+#pragma omp parallel
+{
+    std::vector<int> overlap(k, 0), touched(k); // thread-local counters
+#pragma omp for reduction(+:n_changed)
     for (int i = 0; i < n; ++i) {
-        dis = dist[i]; mae += dis; mse += SQR(dis);
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        int label = -1;
+        if (n_data == 0) { // keep the same label as get_label for empty data
+            label = get_label<DType>(k, n_data, data, seedset, seedpos,
+                nullptr, nullptr);
+        }
+        else {
+            label = index_get_label<DType>(k, n_data, max_item, data,
+                seedpos, postset.data(), postpos.data(), overlap.data(),
+                touched.data());
+        }
+        n_changed += (label != last_labels[i]); labels[i] = label;
     }
-    mae /= n; mse /= n;
+}
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int get_label_and_bounds(           // get label (0,k-1) and its two nn dists
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    float &upper,                       // dist to the nearest seed (return)
+    float &lower)                       // dist to the 2nd nearest seed (return)
+{
+    int label = 0;
+    upper = -1.0f; lower = MAX_FLOAT;
     
-    delete[] dist;
+    for (int i = 0; i < k; ++i) {
+        float dist = seed_jaccard_dist<DType>(n_data, i, data, seedset, 
+            seedpos, bitset, bitpos);
+        if (upper < 0 || dist < upper) {
+            if (upper >= 0) lower = upper;
+            upper = dist; label = i;
+        }
+        else if (dist < lower) lower = dist;
+    }
+    return label;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void calc_seed_drift(               // calc the drift of each seed
+    int   k,                            // number of seeds
+    const int *last_ids,                // last seed id of each seed
+    const DType *last_seedset,          // last seed set
+    const u64 *last_seedpos,            // last seed position
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    float *drift)                       // drift of each seed (return)
+{
+#pragma omp parallel for
+    for (int i = 0; i < k; ++i) {
+        int j = last_ids[i];
+        int n_last = get_length(j, last_seedpos);
+        int n_seed = get_length(i, seedpos);
+        
+        drift[i] = jaccard_dist<DType>(n_last, n_seed, last_seedset +
+            last_seedpos[j], seedset + seedpos[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void calc_seed_gap(                 // calc half dist to the nearest other seed
+    int   k,                            // number of seeds
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    float *gap)                         // half gap of each seed (return)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < k; ++i) {
+        int n_seed = get_length(i, seedpos);
+        const DType *seed = seedset + seedpos[i];
+        
+        float min_dist = MAX_FLOAT;
+        for (int j = 0; j < k; ++j) {
+            if (j == i) continue;
+            float dist = jaccard_dist<DType>(n_seed, get_length(j, seedpos),
+                seed, seedset + seedpos[j]);
+            if (dist < min_dist) min_dist = dist;
+        }
+        // subtract a slack for the rounding error of jaccard distance
+        gap[i] = 0.5f * min_dist - FLOAT_ERROR;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int bound_assign_data(              // sparse data assignment by bounds
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const float *drift,                 // drift of seeds (nullptr: no bounds)
+    const float *gap,                   // half gap of seeds (nullptr: no bounds)
+    float *upper,                       // upper bound of dist to label (return)
+    float *lower,                       // lower bound of dist to others (return)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    u64   &pruned)                      // number of pruned dist evals (return)
+{
+    // no valid bounds yet, scan all k seeds to init bounds and labels
+    int n_changed = 0; // number of labels changed since last iteration
+    pruned = 0UL;
+    if (drift == nullptr || gap == nullptr) {
+#pragma omp parallel for reduction(+:n_changed)
+        for (int i = 0; i < n; ++i) {
+            int n_data = get_length(i, datapos);
+            const DType *data = dataset + datapos[i];
+            
+            int label = get_label_and_bounds<DType>(k, n_data, data, seedset,
+                seedpos, bitset, bitpos, upper[i], lower[i]);
+            n_changed += (label != last_labels[i]); labels[i] = label;
+        }
+        return n_changed;
+    }
+    
+    // get the largest two drifts, so the lower bound for the seed of a data
+    // can be updated by the largest drift among the other seeds
+    int   max_id = 0;
+    float max_drift = -1.0f, max_drift2 = 0.0f;
+    for (int j = 0; j < k; ++j) {
+        if (drift[j] > max_drift) {
+            max_drift2 = std::max(max_drift, 0.0f);
+            max_drift = drift[j]; max_id = j;
+        }
+        else if (drift[j] > max_drift2) max_drift2 = drift[j];
+    }
+    
+    // update the bounds by the drifts (with a slack for the rounding error),
+    // then only rescan the data whose bounds cannot prove its label
+    u64 n_pruned = 0UL;
+#pragma omp parallel for reduction(+:n_pruned,n_changed)
+    for (int i = 0; i < n; ++i) {
+        int a = last_labels[i]; labels[i] = a; // keep the label if pruned
+        upper[i] += drift[a] + FLOAT_ERROR;
+        lower[i] -= (a == max_id ? max_drift2 : max_drift) + FLOAT_ERROR;
+        
+        float bound = std::max(lower[i], gap[a]);
+        if (upper[i] < bound) { n_pruned += k; continue; }
+        
+        // tighten the upper bound by the exact dist to its seed
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        upper[i] = seed_jaccard_dist<DType>(n_data, a, data, seedset, seedpos, 
+            bitset, bitpos) + FLOAT_ERROR;
+        if (upper[i] < bound) { n_pruned += k-1; continue; }
+        
+        labels[i] = get_label_and_bounds<DType>(k, n_data, data, seedset,
+            seedpos, bitset, bitpos, upper[i], lower[i]);
+        n_changed += (labels[i] != a);
+    }
+    pruned = n_pruned;
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+void sort_seeds_by_length(          // sort seed ids by seed length
+    int   k,                            // number of seeds
+    const u64 *seedpos,                 // seed position
+    int   *order,                       // seed ids sorted by length (return)
+    int   *lens);                       // sorted seed lengths (return)
+
+// -----------------------------------------------------------------------------
+inline float length_bound(          // lower bound of jaccard dist by lengths
+    int   a,                            // length of set a
+    int   b)                            // length of set b
+{
+    // the same expression as jaccard_dist with overlap = min(a,b), so that the
+    // bound never exceeds the distance even with rounding error
+    int min_len = std::min(a, b);
+    return 1.0f - (float) min_len / (a + b - min_len);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int length_get_label(               // get label (0,k-1) by length pruning
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *order,                 // seed ids sorted by length
+    const int   *lens,                  // sorted seed lengths
+    int   &checked)                     // number of checked seeds (return)
+{
+    int   label = -1;
+    float nn_dist = MAX_FLOAT;
+    
+    // visit seeds from the length of data towards both sides, in ascending
+    // order of the length bound, and stop once it exceeds the best distance
+    int r = std::lower_bound(lens, lens+k, n_data) - lens;
+    int l = r - 1;
+    checked = 0;
+    while (l >= 0 || r < k) {
+        float l_bound = l >= 0 ? length_bound(n_data, lens[l]) : MAX_FLOAT;
+        float r_bound = r <  k ? length_bound(n_data, lens[r]) : MAX_FLOAT;
+        
+        int pos = -1; float bound = -1.0f;
+        if (l_bound <= r_bound) { pos = l--; bound = l_bound; }
+        else { pos = r++; bound = r_bound; }
+        if (bound > nn_dist) break;
+        
+        int sid = order[pos];
+        float dist = seed_jaccard_dist<DType>(n_data, sid, data, seedset, 
+            seedpos, bitset, bitpos);
+        if (dist < nn_dist || (dist == nn_dist && sid < label)) {
+            nn_dist = dist; label = sid;
+        }
+        ++checked;
+    }
+    return label;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int length_assign_data(             // sparse data assignment by length pruning
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    u64   &pruned)                      // number of pruned dist evals (return)
+{
+    // sort seeds by their lengths for this iteration
+    std::vector<int> order(k), lens(k);
+    sort_seeds_by_length(k, seedpos, order.data(), lens.data());
+    
+    int n_changed = 0; // number of labels changed since last iteration
+    u64 n_pruned  = 0UL;
+#pragma omp parallel for reduction(+:n_pruned,n_changed)
+    for (int i = 0; i < n; ++i) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        int label = -1, checked = k;
+        if (n_data == 0) { // keep the same label as get_label for empty data
+            label = get_label<DType>(k, n_data, data, seedset, seedpos,
+                bitset, bitpos);
+        }
+        else {
+            checked = 0;
+            label = length_get_label<DType>(k, n_data, data, seedset, seedpos,
+                bitset, bitpos, order.data(), lens.data(), checked);
+        }
+        n_pruned  += k - checked;
+        n_changed += (label != last_labels[i]); labels[i] = label;
+    }
+    pruned = n_pruned;
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void minhash_signature(             // calc minhash signature of a set
+    int   n_set,                        // length of the set (n_set > 0)
+    int   n_hash,                       // number of hash functions
+    const DType *set,                   // the set
+    const u64   *hash_a,                // hash coefficients a
+    const u64   *hash_b,                // hash coefficients b
+    u32   *sig)                         // minhash signature (return)
+{
+    for (int h = 0; h < n_hash; ++h) {
+        u64 min_val = UINT32_PRIME, a = hash_a[h], b = hash_b[h];
+        for (int j = 0; j < n_set; ++j) {
+            u64 val = (a * (u64) set[j] + b) % UINT32_PRIME;
+            if (val < min_val) min_val = val;
+        }
+        sig[h] = (u32) min_val;
+    }
+}
+
+// -----------------------------------------------------------------------------
+inline u64 band_key(                // get the bucket key of a band
+    int   n_rows,                       // number of rows in a band
+    const u32 *sig)                     // signature of this band
+{
+    u64 key = 0xcbf29ce484222325UL; // FNV-1a style mixing
+    for (int r = 0; r < n_rows; ++r) {
+        key ^= sig[r]; key *= 0x100000001b3UL; key ^= key >> 29;
+    }
+    return key;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void build_lsh_tables(              // build banded minhash lsh tables of seeds
+    int   k,                            // number of seeds
+    int   n_bands,                      // number of bands
+    int   n_rows,                       // number of rows per band
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    std::vector<u64> &hash_a,           // hash coefficients a (return)
+    std::vector<u64> &hash_b,           // hash coefficients b (return)
+    std::vector<std::pair<u64,int> > &tables) // lsh tables (return)
+{
+    // init the same hash functions for every iteration; they are hashed from
+    // their ids rather than drawn by rand(), so the global random state used
+    // by seeding and sampling is not reset in every iteration
+    int n_hash = n_bands * n_rows;
+    hash_a.resize(n_hash); hash_b.resize(n_hash);
+    u64 stream = mix64((u64) RANDOM_SEED << 32 | 0x15B) * 0x9E3779B97F4A7C15UL;
+    for (int h = 0; h < n_hash; ++h) {
+        hash_a[h] = 1UL + mix64(stream + 2*h) % (UINT32_PRIME-1);
+        hash_b[h] = mix64(stream + 2*h+1) % UINT32_PRIME;
+    }
+    
+    // each band has k (key, seed id) pairs sorted by key; empty seeds use a 
+    // key that no data can hit
+    tables.resize((u64) n_bands*k);
+#pragma omp parallel
+{
+    std::vector<u32> sig(n_hash);
+#pragma omp for
+    for (int i = 0; i < k; ++i) {
+        int n_seed = get_length(i, seedpos);
+        if (n_seed > 0) {
+            minhash_signature<DType>(n_seed, n_hash, seedset + seedpos[i], 
+                hash_a.data(), hash_b.data(), sig.data());
+        }
+        for (int t = 0; t < n_bands; ++t) {
+            u64 key = n_seed > 0 ? band_key(n_rows, &sig[t*n_rows]) : 0UL;
+            tables[(u64) t*k+i] = std::make_pair(key, n_seed > 0 ? i : -1);
+        }
+    }
+}
+    for (int t = 0; t < n_bands; ++t) {
+        std::sort(tables.begin() + (u64) t*k, tables.begin() + (u64) (t+1)*k);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int lsh_assign_data(                // approximate assignment by minhash lsh
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    int   n_bands,                      // number of bands
+    int   n_rows,                       // number of rows per band
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    float &audit)                       // audited label error (return)
+{
+    // minhash all seeds into banded lsh tables for this iteration
+    std::vector<u64> hash_a, hash_b;
+    std::vector<std::pair<u64,int> > tables; // k (key, seed id) pairs per band
+    build_lsh_tables(k, n_bands, n_rows, seedset, seedpos, hash_a, hash_b, 
+        tables);
+    
+    int n_hash = n_bands * n_rows, n_changed = 0;
+#pragma omp parallel
+{
+    std::vector<u32> sig(n_hash);
+    std::vector<int> visited(k, -1); // the last data id visiting each seed
+#pragma omp for reduction(+:n_changed)
+    for (int i = 0; i < n; ++i) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        int last = last_labels[i]; // read before labels[i] is written
+        if (n_data == 0) { // keep the same label as get_label for empty data
+            labels[i] = get_label<DType>(k, n_data, data, seedset, seedpos,
+                bitset, bitpos);
+            n_changed += (labels[i] != last); continue;
+        }
+        minhash_signature<DType>(n_data, n_hash, data, hash_a.data(), 
+            hash_b.data(), sig.data());
+        
+        // verify the candidate seeds from each band by exact jaccard distance
+        int   label = -1;
+        float nn_dist = MAX_FLOAT;
+        for (int t = 0; t < n_bands; ++t) {
+            std::pair<u64,int> key(band_key(n_rows, &sig[t*n_rows]), -1);
+            const std::pair<u64,int> *table = tables.data() + (u64) t*k;
+            const std::pair<u64,int> *it = std::lower_bound(table, table+k, key);
+            
+            for (; it != table+k && it->first == key.first; ++it) {
+                int sid = it->second;
+                if (sid < 0 || visited[sid] == i) continue;
+                visited[sid] = i;
+                
+                float dist = seed_jaccard_dist<DType>(n_data, sid, data, 
+                    seedset, seedpos, bitset, bitpos);
+                if (dist < nn_dist || (dist == nn_dist && sid < label)) {
+                    nn_dist = dist; label = sid;
+                }
+            }
+        }
+        // fall back to the exact assignment if no candidate is found
+        if (label < 0) {
+            label = get_label<DType>(k, n_data, data, seedset, seedpos, 
+                bitset, bitpos);
+        }
+        n_changed += (label != last); labels[i] = label;
+    }
+}
+    // audit the labels on a sampled subset against the exact assignment
+    int step = std::max(1, n / LSH_AUDIT), n_audit = 0, n_diff = 0;
+#pragma omp parallel for reduction(+:n_audit,n_diff)
+    for (int i = 0; i < n; i += step) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        int label = get_label<DType>(k, n_data, data, seedset, seedpos, 
+            bitset, bitpos);
+        n_diff += (label != labels[i]); ++n_audit;
+    }
+    audit = (float) n_diff / n_audit;
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+inline bool lex_less(               // (d1,id1) < (d2,id2) in lexicographic order
+    float d1,                           // distance 1
+    int   id1,                          // seed id 1
+    float d2,                           // distance 2
+    int   id2)                          // seed id 2
+{
+    return d1 < d2 || (d1 == d2 && id1 < id2);
+}
+
+// -----------------------------------------------------------------------------
+inline void push_top2(              // push (dist,id) into the top-2 nn seeds
+    float dist,                         // distance
+    int   id,                           // seed id
+    float &dist1,                       // dist to the nearest seed (return)
+    int   &id1,                         // id of the nearest seed (return)
+    float &dist2,                       // dist to the 2nd nearest seed (return)
+    int   &id2)                         // id of the 2nd nearest seed (return)
+{
+    if (lex_less(dist, id, dist1, id1)) {
+        dist2 = dist1; id2 = id1; dist1 = dist; id1 = id;
+    }
+    else if (lex_less(dist, id, dist2, id2)) { dist2 = dist; id2 = id; }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int get_top2_labels(                // get the top-2 nn seeds for input data
+    int   k,                            // number of seeds
+    int   n_data,                       // length of input data
+    const DType *data,                  // input data
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    float &dist1,                       // dist to the nearest seed (return)
+    float &dist2,                       // dist to the 2nd nearest seed (return)
+    int   &id2)                         // id of the 2nd nearest seed (return)
+{
+    int id1 = k; id2 = k;
+    dist1 = dist2 = MAX_FLOAT;
+    for (int i = 0; i < k; ++i) {
+        float dist = seed_jaccard_dist<DType>(n_data, i, data, seedset, 
+            seedpos, bitset, bitpos);
+        push_top2(dist, i, dist1, id1, dist2, id2);
+    }
+    if (id2 == k) id2 = -1; // no 2nd nearest seed if k == 1
+    return id1;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int find_changed_seeds(             // find seeds changed since last iteration
+    int   k,                            // number of seeds
+    const int *last_ids,                // last seed id of each seed
+    const DType *last_seedset,          // last seed set
+    const u64 *last_seedpos,            // last seed position
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    int   *changed,                     // changed flag of each seed (return)
+    int   *changed_ids)                 // ids of changed seeds (return)
+{
+    int n_changed = 0;
+    for (int i = 0; i < k; ++i) {
+        int j = last_ids[i];
+        int len = get_length(i, seedpos);
+        const DType *seed = seedset + seedpos[i];
+        const DType *last = last_seedset + last_seedpos[j];
+        
+        changed[i] = len != get_length(j, last_seedpos) || 
+            !std::equal(seed, seed+len, last);
+        if (changed[i]) changed_ids[n_changed++] = i;
+    }
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int incremental_assign_data(        // sparse data assignment by changed seeds
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    int   n_updated,                    // number of changed seeds
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    int   n_last,                       // size of last_to_new
+    const int   *last_to_new,           // last id -> new id (nullptr: no cache)
+    const int   *changed,               // changed flag of each seed
+    const int   *changed_ids,           // ids of changed seeds
+    float *dist1,                       // cached dist to label (return)
+    float *dist2,                       // cached dist to 2nd nn seed (return)
+    int   *id2,                         // cached id of 2nd nn seed (return)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    u64   &pruned)                      // number of pruned dist evals (return)
+{
+    int n_changed = 0; // number of labels changed since last iteration
+    u64 n_pruned  = 0UL;
+#pragma omp parallel for reduction(+:n_pruned,n_changed)
+    for (int i = 0; i < n; ++i) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        int a = last_labels[i]; // read before labels[i] is written
+        
+        // no valid cache yet, or its 2nd nn seed has gone (empty bin)
+        int b = id2[i], bn = -1;
+        if (last_to_new != nullptr && b >= 0) bn = b < n_last ? last_to_new[b] : -1;
+        if (last_to_new == nullptr || (b >= 0 && bn < 0)) {
+            labels[i] = get_top2_labels<DType>(k, n_data, data, seedset, 
+                seedpos, bitset, bitpos, dist1[i], dist2[i], id2[i]);
+            n_changed += (labels[i] != a); continue;
+        }
+        
+        // the unchanged seeds have the same dist as last iteration, and all of
+        // them except the cached top-2 are no closer than (dist2, bn), so only
+        // the changed seeds should be re-scored
+        int   n1 = k, n2 = k;
+        float d1 = MAX_FLOAT, d2 = MAX_FLOAT;
+        float bound = bn >= 0 ? dist2[i] : MAX_FLOAT;
+        if (bn < 0) bn = k;
+        
+        if (!changed[a]) push_top2(dist1[i], a, d1, n1, d2, n2);
+        if (bn < k && !changed[bn]) push_top2(bound, bn, d1, n1, d2, n2);
+        for (int j = 0; j < n_updated; ++j) {
+            int sid = changed_ids[j];
+            float dist = seed_jaccard_dist<DType>(n_data, sid, data, seedset, 
+                seedpos, bitset, bitpos);
+            push_top2(dist, sid, d1, n1, d2, n2);
+        }
+        
+        if (n2 < k && lex_less(bound, bn, d2, n2)) { // cannot prove the top-2
+            labels[i] = get_top2_labels<DType>(k, n_data, data, seedset, 
+                seedpos, bitset, bitpos, dist1[i], dist2[i], id2[i]);
+            n_changed += (labels[i] != a); continue;
+        }
+        labels[i] = n1; dist1[i] = d1; dist2[i] = d2; id2[i] = n2 < k ? n2 : -1;
+        n_changed += (n1 != a);
+        n_pruned  += k - n_updated;
+    }
+    pruned = n_pruned;
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+int nonempty_labels(                // get the non-empty labels in asc. order
+    int n,                              // number of data points
+    int k,                              // number of cluster centers
+    const int *labels,                  // cluster labels for data
+    std::vector<int> &ids);             // non-empty labels (return)
+
+// -----------------------------------------------------------------------------
+u64 labels_to_index(                // convert labels into index and index_pos
+    int   n,                            // number of labels
+    int   k,                            // number of centers
+    int   *labels,                      // data labels (re-numbered on return)
+    std::vector<int> &binset,           // bin set (return)
+    std::vector<u64> &binpos);          // bin position (return)
+
+// -----------------------------------------------------------------------------
+int labels_to_bins(                 // labels to bins & re-number labels
+    int n,                              // number of data points
+    int k,                              // number of centers
+    int *labels,                        // cluster labels for data (return)
+    std::vector<int> &binset,           // bin set (return)
+    std::vector<u64> &binpos);          // bin position (return)
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int frequent_items(                 // find frequent items as a seed
+    int   num,                          // number of point IDs in a bin
+    int   max_len,                      // max length for a seed
+    float alpha,                        // global \alpha \in (0,1)
+    const int   *bin,                   // bin
+    const SparseRows<DType> &rows,      // data set
+    const int   *weights,               // weights of data set (nullptr: 1)
+    DType *buf,                         // buffer of rows (thread-local)
+    ItemCounter &counter,               // item counter (thread-local)
+    std::vector<int> &seed)             // a seed (return)
+{
+    // deal with the special case with a single data
+    if (num == 1) {
+        int   len = 0;
+        const DType *data = rows.get(bin[0], buf, len); // get data & its len
+        
+        len = std::min(max_len, len);
+        seed.assign(data, data+len);
+        return len;
+    }
+    
+    // consider the case with multiple data
+    // count the (weighted) frequency of each coordinate in linear time
+    for (int i = 0; i < num; ++i) {
+        int   id = bin[i], len = 0;
+        const DType *data = rows.get(id, buf, len); // get data & its len
+        int   w = weights != nullptr ? weights[id] : 1;
+        
+        for (int j = 0; j < len; ++j) counter.add((int) data[j], w);
+    }
+    
+    // get the high frequent coordinates (in ascending order) as seed 
+    int threshold = (int) ceil((double) counter.max_freq()*alpha);
+    return counter.extract(threshold, max_len, seed);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int sketch_frequent_items(          // find frequent items by a sketch
+    int   num,                          // number of point IDs in a bin
+    int   max_len,                      // max length for a seed
+    int   capacity,                     // capacity of heavy-hitter sketch
+    float alpha,                        // global \alpha \in (0,1)
+    const int   *bin,                   // bin
+    const SparseRows<DType> &rows,      // data set
+    const int   *weights,               // weights of data set (nullptr: 1)
+    std::vector<int> &seed)             // a seed (return)
+{
+    // each thread summarizes a part of the bin by its own sketch, and the 
+    // partial sketches are merged in the order of thread ids
+    int n_threads = omp_get_max_threads();
+    std::vector<HeavyHitters> parts(n_threads, HeavyHitters(capacity));
+#pragma omp parallel
+{
+    HeavyHitters &part = parts[omp_get_thread_num()];
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+#pragma omp for
+    for (int i = 0; i < num; ++i) {
+        int   id = bin[i], len = 0;
+        const DType *data = rows.get(id, buf.data(), len); // get data & len
+        int   w = weights != nullptr ? weights[id] : 1;
+        
+        for (int j = 0; j < len; ++j) part.add((int) data[j], w);
+    }
+}
+    for (int t = 1; t < n_threads; ++t) {
+        parts[0].merge(parts[t]);
+        HeavyHitters(0).swap(parts[t]);
+    }
+    
+    return parts[0].extract(alpha, max_len, seed);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void build_seed_bitmaps(            // build bitmaps for long seeds
+    int   k,                            // number of seeds
+    int   min_len,                      // min length of seed to use bitmap
+    const DType *seedset,               // seed set
+    const u64 *seedpos,                 // seed position
+    std::vector<u64> &bitset,           // bit set (return)
+    std::vector<u64> &bitpos)           // bit position (return)
+{
+    std::vector<u64>().swap(bitset);
+    std::vector<u64>().swap(bitpos);
+    
+    // a seed uses a bitmap over its own id range [lo,hi] if it is long enough 
+    // and the range fits in MAX_BITMAP bits (always true for u16 data)
+    bitpos.resize(k+1); bitpos[0] = 0;
+    for (int i = 0; i < k; ++i) {
+        int len = get_length(i, seedpos), n_words = 0;
+        if (len >= min_len && len > 0) {
+            const DType *seed = seedset + seedpos[i];
+            u64 span = (u64) (seed[len-1] - seed[0]) + 1;
+            if (span <= MAX_BITMAP) n_words = (int) ((span + 63) >> 6);
+        }
+        bitpos[i+1] = bitpos[i] + n_words;
+    }
+    
+    // set the bits of each seed
+    bitset.resize(bitpos[k], 0UL);
+#pragma omp parallel for
+    for (int i = 0; i < k; ++i) {
+        if (bitpos[i+1] == bitpos[i]) continue;
+        
+        const DType *seed = seedset + seedpos[i];
+        u64 *bits = bitset.data() + bitpos[i];
+        for (u64 j = seedpos[i]; j < seedpos[i+1]; ++j) {
+            u64 off = (u64) (seedset[j] - seed[0]);
+            bits[off>>6] |= 1UL << (off&63);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void place_seeds(                   // place seeds into seedset by seedpos
+    int   k,                            // number of seeds
+    std::vector<std::vector<int> > &seeds, // seeds (released on return)
+    std::vector<DType> &seedset,        // seed set (return)
+    std::vector<u64> &seedpos)          // seed length at [i+1] -> position
+{
+    // determine seedpos by accumulating the size of each seed
+    for (int i = 1; i <= k; ++i) seedpos[i] += seedpos[i-1];
+    
+    // place each seed into seedset and release it right away
+    seedset.resize(seedpos[k]);
+    DType *seedset_ptr = seedset.data();
+#pragma omp parallel for
+    for (int i = 0; i < k; ++i) {
+        std::copy(seeds[i].begin(), seeds[i].end(), seedset_ptr+seedpos[i]);
+        std::vector<int>().swap(seeds[i]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void bins_to_seeds(                 // convert bins into seeds
+    int   n,                            // number of data points
+    int   k,                            // number of bins (and seeds)
+    int   avg_d,                        // average dimension of data points
+    int   max_item,                     // max item id of data set
+    float alpha,                        // \alpha \in (0,1)
+    const SparseRows<DType> &rows,      // data set
+    const int   *binset,                // bin set
+    const u64   *binpos,                // bin position
+    const int   *weights,               // weights of data set (nullptr: 1)
+    int   sketch_size,                  // sketch capacity for giant bins (0: no)
+    int   bitmap_len,                   // min seed length for bitmap (0: none)
+    std::vector<DType> &seedset,        // seed set (return)
+    std::vector<u64> &seedpos,          // seed position (return)
+    std::vector<u64> &bitset,           // bit set (return)
+    std::vector<u64> &bitpos,           // bit position (return)
+    std::vector<f64> &busy)             // busy time of each thread (return)
+{
+    // clear seedset and seedpos
+    std::vector<DType>().swap(seedset);
+    std::vector<u64>().swap(seedpos);
+    
+    // determine k seeds in two phases: (1) find the frequent items of each 
+    // bin and its seed length; (2) prefix-sum the lengths into seedpos and 
+    // place each seed into its slot of seedset, so the peak memory is about 
+    // the total seed length rather than k*max_len
+    int max_len = 100*avg_d; // TODO: the factor 100 can be tuned
+    std::vector<std::vector<int> > seeds(k);
+    seedpos.resize(k+1); seedpos[0] = 0;
+    
+    // get the number of coordinates of each bin as its workload
+    std::vector<u64> bin_size(k, 0UL);
+#pragma omp parallel for
+    for (int i = 0; i < k; ++i) {
+        u64 tot_num = 0UL;
+        for (u64 j = binpos[i]; j < binpos[i+1]; ++j) {
+            tot_num += rows.length(binset[j]);
+        }
+        bin_size[i] = tot_num;
+    }
+    u64 tot_size = 0UL;
+    for (int i = 0; i < k; ++i) tot_size += bin_size[i];
+    
+    // the bins with more than sketch_size coordinates are summarized by the 
+    // heavy-hitter sketch, so the memory is independent of their sizes; the 
+    // big bins with more than 1/T of all coordinates are split into chunks 
+    // counted by all T threads; the other bins are scheduled dynamically in 
+    // descending order of their sizes (longest processing time first)
+    int n_threads = omp_get_max_threads();
+    std::vector<int> giant_bins, big_bins, small_bins;
+    for (int i = 0; i < k; ++i) {
+        if (sketch_size > 0 && bin_size[i] > (u64) sketch_size) {
+            giant_bins.push_back(i);
+        }
+        else if (n_threads > 1 && bin_size[i]*n_threads > tot_size) {
+            big_bins.push_back(i);
+        }
+        else small_bins.push_back(i);
+    }
+    std::stable_sort(small_bins.begin(), small_bins.end(), 
+        [&bin_size](int a, int b) { return bin_size[a] > bin_size[b]; });
+    
+    std::vector<ItemCounter*> counters(n_threads, nullptr);
+#pragma omp parallel
+{
+    int tid = omp_get_thread_num();
+    ItemCounter counter(max_item); // thread-local counter
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+    counters[tid] = &counter;
+    
+    // the team may have fewer than n_threads threads (e.g., OMP_DYNAMIC), so 
+    // busy and the tree reduction are sized by the actual team; the busy time
+    // is summed in a local and stored once, so no cache line is shared
+#pragma omp single
+    busy.assign(omp_get_num_threads(), 0.0);
+    int n_team = (int) busy.size();
+    double my_busy = 0.0;
+    
+    // count the chunks of each big bin into the thread-local counters, then 
+    // merge the partial counters by a tree reduction into counters[0]
+    for (int i : big_bins) {
+        const int *bin = binset + binpos[i];  // get a bin
+        int num = get_length(i, binpos); // get # point ID's in a bin
+        
+        // only counters[0] (the merge target) gets the items of the whole 
+        // bin, and the others about 1/n_team of them
+        double start_wtime = omp_get_wtime();
+        counter.reserve(tid == 0 ? bin_size[i] : bin_size[i] / n_team + 1);
+#pragma omp for schedule(dynamic, 64) nowait
+        for (int j = 0; j < num; ++j) {
+            int   id = bin[j], len = 0;
+            const DType *data = rows.get(id, buf.data(), len); // data & len
+            int   w = weights != nullptr ? weights[id] : 1;
+            
+            for (int l = 0; l < len; ++l) counter.add((int) data[l], w);
+        }
+        my_busy += omp_get_wtime() - start_wtime;
+#pragma omp barrier
+        for (int step = 1; step < n_team; step <<= 1) {
+            start_wtime = omp_get_wtime();
+            if (tid % (2*step) == 0 && tid+step < n_team) {
+                counter.merge(*counters[tid+step]);
+            }
+            my_busy += omp_get_wtime() - start_wtime;
+#pragma omp barrier
+        }
+        if (tid == 0) {
+            start_wtime = omp_get_wtime();
+            int threshold = (int) ceil((double) counter.max_freq()*alpha);
+            seedpos[i+1] = counter.extract(threshold, max_len, seeds[i]);
+            my_busy += omp_get_wtime() - start_wtime;
+        }
+    }
+    
+#pragma omp for schedule(dynamic)
+    for (size_t b = 0; b < small_bins.size(); ++b) {
+        int i = small_bins[b];
+        const int *bin = binset + binpos[i];  // get a bin
+        int num = get_length(i, binpos); // get # point ID's in a bin
+        
+        double start_wtime = omp_get_wtime();
+        seedpos[i+1] = frequent_items<DType>(num, max_len, alpha, bin, rows, 
+            weights, buf.data(), counter, seeds[i]);
+        my_busy += omp_get_wtime() - start_wtime;
+    }
+    busy[tid] = my_busy;
+}
+    for (int i : giant_bins) {
+        seedpos[i+1] = sketch_frequent_items<DType>(get_length(i, binpos), 
+            max_len, sketch_size, alpha, binset + binpos[i], rows, weights, 
+            seeds[i]);
+    }
+    
+    place_seeds(k, seeds, seedset, seedpos);
+    
+    // emit bitmaps for long seeds (hybrid seed representation)
+    if (bitmap_len > 0) {
+        build_seed_bitmaps(k, bitmap_len, seedset.data(), seedpos.data(), 
+            bitset, bitpos);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int count_assign_data(              // exact assignment with item counting
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    const SparseRows<DType> &rows,      // data set
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *weights,               // weights of data set (nullptr: 1)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    int   *sizes,                       // #points per thread & cluster (update)
+    std::vector<ClusterItemCounter> &counters, // counter per thread (update)
+    double *stat)                       // sum of w, w*dist, w*dist^2 (update)
+{
+    // decide the label of each point and add its items into the counter of 
+    // (cluster, item) pairs of this thread; the sizes, counters and stat are 
+    // accumulated, so a data set can be processed in several chunks
+    int n_changed = 0; // number of labels changed since last iteration
+    double sum_w = 0.0, sum_d = 0.0, sum_d2 = 0.0;
+#pragma omp parallel reduction(+:n_changed,sum_w,sum_d,sum_d2)
+{
+    int tid = omp_get_thread_num();
+    int *size = sizes + (u64) tid*k;
+    ClusterItemCounter &counter = counters[tid];
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+#pragma omp for
+    for (int i = 0; i < n; ++i) {
+        int   n_data = 0;
+        const DType *data = rows.get(i, buf.data(), n_data);
+        
+        float nn_dist = -1.0f;
+        int label = get_nn_label<DType>(k, n_data, data, seedset, seedpos, 
+            bitset, bitpos, nn_dist);
+        n_changed += (label != last_labels[i]); labels[i] = label;
+        ++size[label];
+        
+        int w = weights != nullptr ? weights[i] : 1;
+        for (int j = 0; j < n_data; ++j) counter.add(label, (int) data[j], w);
+        sum_w += w; sum_d += w * nn_dist; sum_d2 += (double) w * SQR(nn_dist);
+    }
+}
+    stat[0] += sum_w; stat[1] += sum_d; stat[2] += sum_d2;
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int counts_to_seeds(                // convert per-cluster counts into seeds
+    int   k,                            // number of clusters
+    int   avg_d,                        // average dimension of data points
+    int   max_item,                     // max item id of data set
+    float alpha,                        // \alpha \in (0,1)
+    const int *sizes,                   // #points per thread & cluster
+    std::vector<ClusterItemCounter> &counters, // counter per thread (cleared)
+    int   *new_id,                      // new label of each label (return)
+    int   *old_ids,                     // old label of each new label (return)
+    std::vector<DType> &seedset,        // seed set (return)
+    std::vector<u64> &seedpos,          // seed position (return)
+    std::vector<f64> &busy)             // busy time of each thread (return)
+{
+    // group the pairs of each thread by cluster, re-number the non-empty 
+    // clusters in ascending order of their labels, then merge the partial 
+    // counts of each cluster and apply the threshold
+    int n_threads = (int) counters.size();
+    int max_len = 100*avg_d; // TODO: the factor 100 can be tuned
+    int n_bins = 0;
+    std::vector<std::vector<u64> > grp_pos(n_threads);
+    std::vector<std::vector<int> > grp_items(n_threads), grp_cnts(n_threads);
+    std::vector<std::vector<int> > seeds;
+#pragma omp parallel
+{
+    int tid = omp_get_thread_num();
+    ItemCounter counter(max_item); // thread-local counter
+    
+    // the busy time is summed in a local and stored once (see bins_to_seeds)
+#pragma omp single
+    busy.assign(omp_get_num_threads(), 0.0);
+    double my_busy = 0.0;
+    
+    double start_wtime = omp_get_wtime();
+#pragma omp for nowait
+    for (int t = 0; t < n_threads; ++t) {
+        counters[t].group(k, grp_pos[t], grp_items[t], grp_cnts[t]);
+    }
+    my_busy += omp_get_wtime() - start_wtime;
+#pragma omp barrier
+    
+#pragma omp single
+    {
+        for (int c = 0; c < k; ++c) {
+            int num = 0;
+            for (int t = 0; t < n_threads; ++t) num += sizes[(u64) t*k+c];
+            new_id[c] = -1;
+            if (num > 0) { old_ids[n_bins] = c; new_id[c] = n_bins++; }
+        }
+        assert(n_bins > 0);
+        seeds.resize(n_bins); seedpos.assign(n_bins+1, 0UL);
+    }
+    start_wtime = omp_get_wtime();
+#pragma omp for schedule(dynamic) nowait
+    for (int c = 0; c < k; ++c) {
+        int id = new_id[c]; if (id < 0) continue;
+        
+        for (int t = 0; t < n_threads; ++t) {
+            for (u64 j = grp_pos[t][c]; j < grp_pos[t][c+1]; ++j) {
+                counter.add(grp_items[t][j], grp_cnts[t][j]);
+            }
+        }
+        int threshold = (int) ceil((double) counter.max_freq()*alpha);
+        seedpos[id+1] = counter.extract(threshold, max_len, seeds[id]);
+    }
+    my_busy += omp_get_wtime() - start_wtime;
+    busy[tid] = my_busy;
+}
+    place_seeds(n_bins, seeds, seedset, seedpos);
+    
+    return n_bins;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int fused_assign_data(              // exact assignment fused with counting
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    int   avg_d,                        // average dimension of data points
+    int   max_item,                     // max item id of data set
+    float alpha,                        // \alpha \in (0,1)
+    const SparseRows<DType> &rows,      // data set
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *weights,               // weights of data set (nullptr: 1)
+    const int   *last_labels,           // last labels (may alias labels)
+    int   *labels,                      // cluster labels for dataset (return)
+    int   &n_bins,                      // number of non-empty clusters (return)
+    int   *old_ids,                     // old label of each new label (return)
+    double *stat,                       // sum of w, w*dist, w*dist^2 (return)
+    std::vector<DType> &new_seedset,    // new seed set (return)
+    std::vector<u64> &new_seedpos,      // new seed position (return)
+    std::vector<f64> &busy)             // busy time of each thread (return)
+{
+    // stream the data once: the items of each point are counted for its new
+    // label, so no bins are built and no data is gathered again
+    int n_threads = omp_get_max_threads();
+    std::vector<int> sizes((u64) n_threads*k, 0);
+    std::vector<ClusterItemCounter> counters(n_threads);
+    
+    stat[0] = stat[1] = stat[2] = 0.0;
+    int n_changed = count_assign_data<DType>(n, k, rows, seedset, seedpos, 
+        bitset, bitpos, weights, last_labels, labels, sizes.data(), counters, 
+        stat);
+    
+    // re-number the labels to the non-empty clusters
+    std::vector<int> new_id(k);
+    n_bins = counts_to_seeds(k, avg_d, max_item, alpha, sizes.data(), counters, 
+        new_id.data(), old_ids, new_seedset, new_seedpos, busy);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) labels[i] = new_id[labels[i]];
+    
+    return n_changed;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+float calc_jaccard_dist(            // calc jaccard dist between data & seed
+    int   did,                          // data id
+    int   sid,                          // label (seed id)
+    const SparseRows<DType> &rows,      // data set
+    DType *buf,                         // buffer of rows (thread-local)
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos)                // bit position (nullptr: no bitmaps)
+{
+    int   n_data = 0;
+    const DType *data = rows.get(did, buf, n_data);
+    
+    return seed_jaccard_dist<DType>(n_data, sid, data, seedset, seedpos, 
+        bitset, bitpos);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void calc_stat_by_seeds(            // calc statistics by seeds
+    int   n,                            // number of data points
+    int   k,                            // number of clusters
+    const int   *labels,                // cluster labels for data points
+    const SparseRows<DType> &rows,      // data set
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *weights,               // weights of data set (nullptr: 1)
+    float &mae,                         // mean absolute error (return)
+    float &mse)                         // mean square   error (return)
+{
+    // calc the jaccard distance for local data to its seed, and sum up the 
+    // (weighted) distances by a parallel reduction in double
+    double sum_w = 0.0, sum_d = 0.0, sum_d2 = 0.0;
+#pragma omp parallel reduction(+:sum_w,sum_d,sum_d2)
+{
+    std::vector<DType> buf(rows.buf_len()); // thread-local buffer
+#pragma omp for
+    for (int i = 0; i < n; ++i) {
+        double dist = calc_jaccard_dist<DType>(i, labels[i], rows, buf.data(), 
+            seedset, seedpos, bitset, bitpos);
+        double w = weights != nullptr ? weights[i] : 1.0;
+        sum_w += w; sum_d += w * dist; sum_d2 += w * SQR(dist);
+    }
+}
+    mae = (float) (sum_d / sum_w); mse = (float) (sum_d2 / sum_w);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void stream_assign_data(            // assign data & calc stat in one pass
+    int   n,                            // number of data points
+    int   k,                            // number of seeds
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const DType *seedset,               // seed set
+    const u64   *seedpos,               // seed position
+    const u64   *bitset,                // bit set (nullptr: no bitmaps)
+    const u64   *bitpos,                // bit position (nullptr: no bitmaps)
+    const int   *weights,               // weights of data set (nullptr: 1)
+    int   *labels,                      // cluster labels for dataset (return)
+    float &mae,                         // mean absolute error (return)
+    float &mse)                         // mean square   error (return)
+{
+    double sum_w = 0.0, sum_d = 0.0, sum_d2 = 0.0;
+#pragma omp parallel for reduction(+:sum_w,sum_d,sum_d2)
+    for (int i = 0; i < n; ++i) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        float nn_dist = -1.0f;
+        int label = get_nn_label<DType>(k, n_data, data, seedset, seedpos, 
+            bitset, bitpos, nn_dist);
+        double w = weights != nullptr ? weights[i] : 1.0;
+        labels[i] = label; sum_w += w; 
+        sum_d += w * nn_dist; sum_d2 += w * SQR(nn_dist);
+    }
+    mae = (float) (sum_d / sum_w); mse = (float) (sum_d2 / sum_w);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int build_coreset(                  // build a coreset by sensitivity sampling
+    int   n,                            // number of data points
+    int   k,                            // number of clusters
+    int   m,                            // expected coreset size
+    const DType *dataset,               // data set
+    const u64   *datapos,               // data position
+    const int   *weights,               // weights of data set (nullptr: 1)
+    std::vector<int> &cs_ids,           // data ids of coreset (return)
+    std::vector<int> &cs_weights)       // weights of coreset (return)
+{
+    // -------------------------------------------------------------------------
+    //  get a rough solution B: k-means++ seeds of a uniform sample of size m
+    // -------------------------------------------------------------------------
+    std::vector<int> sample_ids;
+    for (int i = 0; i < n; ++i) {
+        if (hash_uniform(RANDOM_SEED, i) * n < m) sample_ids.push_back(i);
+    }
+    int n_sample = (int) sample_ids.size();
+    if (n_sample < k) return 0;
+    
+    std::vector<DType> sample_set;
+    std::vector<u64>   sample_pos;
+    gather_data<DType>(n_sample, sample_ids.data(), dataset, datapos, 
+        sample_set, sample_pos);
+    
+    std::vector<int> ones(n_sample, 1), ids(k);
+    std::vector<DType> rough_set;
+    std::vector<u64> rough_pos;
+    kmeanspp_seeding<DType>(n_sample, k, SparseRows<DType>(n_sample, 
+        sample_set.data(), sample_pos.data()), ones.data(), ids.data(), 
+        rough_set, rough_pos);
+    std::vector<DType>().swap(sample_set);
+    std::vector<u64>().swap(sample_pos);
+    
+    // -------------------------------------------------------------------------
+    //  one pass over the data: the nn dist & nn seed in B of each data
+    // -------------------------------------------------------------------------
+    std::vector<float>  nn_dist(n);
+    std::vector<int>    nn_id(n);
+    std::vector<double> cnt(k, 0.0);
+    double cost = 0.0;
+#pragma omp parallel
+{
+    std::vector<double> local_cnt(k, 0.0); // thread-local cluster sizes
+#pragma omp for reduction(+:cost)
+    for (int i = 0; i < n; ++i) {
+        int n_data = get_length(i, datapos);
+        const DType *data = dataset + datapos[i];
+        
+        nn_dist[i] = MAX_FLOAT;
+        for (int j = 0; j < k; ++j) {
+            float dist = seed_jaccard_dist<DType>(n_data, j, data, 
+                rough_set.data(), rough_pos.data(), nullptr, nullptr);
+            if (dist < nn_dist[i]) { nn_dist[i] = dist; nn_id[i] = j; }
+        }
+        double w = weights != nullptr ? weights[i] : 1.0;
+        local_cnt[nn_id[i]] += w; cost += w * SQR(nn_dist[i]);
+    }
+#pragma omp critical
+    for (int j = 0; j < k; ++j) cnt[j] += local_cnt[j];
+}
+    
+    // -------------------------------------------------------------------------
+    //  sensitivity sampling: s(x) = D(x,B)^2/cost + 1/|B(x)|, and each data
+    //  (of weight w) is kept independently with prob p = min(1, m*w*s(x)/S) 
+    //  & weight w/p
+    // -------------------------------------------------------------------------
+    int n_used = 0; // number of non-empty clusters in B
+    for (int j = 0; j < k; ++j) if (cnt[j] > 0) ++n_used;
+    double S = n_used + (cost > 0 ? 1.0 : 0.0); // total sensitivity
+    
+    std::vector<std::pair<int,int> > samples; // (data id, weight)
+#pragma omp parallel
+{
+    std::vector<std::pair<int,int> > local_samples;
+#pragma omp for nowait
+    for (int i = 0; i < n; ++i) {
+        double s = 1.0 / cnt[nn_id[i]];
+        if (cost > 0) s += SQR((double) nn_dist[i]) / cost;
+        
+        double w = weights != nullptr ? weights[i] : 1.0;
+        double p = std::min(1.0, m * w * s / S);
+        if (hash_uniform((u64) RANDOM_SEED << 32 | 1, i) < p) {
+            int cs_w = (int) std::min((double) MAX_INT, floor(w / p + 0.5));
+            local_samples.push_back(std::make_pair(i, std::max(cs_w, 1)));
+        }
+    }
+#pragma omp critical
+    samples.insert(samples.end(), local_samples.begin(), local_samples.end());
+}
+    std::sort(samples.begin(), samples.end()); // independent of #threads
+    
+    int size = (int) samples.size();
+    cs_ids.resize(size); cs_weights.resize(size);
+    for (int j = 0; j < size; ++j) {
+        cs_ids[j] = samples[j].first; cs_weights[j] = samples[j].second;
+    }
+    return size;
 }
 
 } // end namespace clustering
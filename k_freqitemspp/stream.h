@@ -0,0 +1,535 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "def.h"
+#include "util.h"
+#include "seeding.h"
+#include "k_freqitems.h"
+
+namespace clustering {
+
+// -----------------------------------------------------------------------------
+//  Chunk: a range of data points read from disk, with the positions re-based
+//  to the start of the chunk and the spilled labels of the last iteration
+// -----------------------------------------------------------------------------
+template<class DType>
+struct Chunk {
+    int   start_;                   // id of the first data point
+    int   n_;                       // number of data points
+    double read_time_;              // time to read this chunk (s)
+    u64   bytes_;                   // bytes read for this chunk
+    std::vector<u64>   pos_;        // data position (re-based)
+    std::vector<DType> data_;       // data
+    std::vector<int>   last_;       // spilled labels (empty: no labels)
+};
+
+// -----------------------------------------------------------------------------
+//  ChunkReader: scan the binary data file (and a spilled label file) in large
+//  sequential chunks, reading the next chunk by a thread while the current one
+//  is processed (double buffering)
+// -----------------------------------------------------------------------------
+template<class DType>
+class ChunkReader {
+public:
+    ChunkReader(                    // constructor
+        int   n,                        // number of data points
+        int   chunk_size,               // chunk size (MB)
+        const char *addr_data);         // address of data set
+    
+    // -------------------------------------------------------------------------
+    ~ChunkReader();                 // destructor
+    
+    // -------------------------------------------------------------------------
+    template<class Func>
+    void scan(                      // read all chunks & process them in order
+        const char *addr_labels,        // spilled labels (nullptr: none)
+        Func  process);                 // process(const Chunk<DType>&)
+    
+    // -------------------------------------------------------------------------
+    u64 num_coords() const { return N_; } // total number of coordinates
+    
+    // -------------------------------------------------------------------------
+    int chunk_rows() const { return rows_; } // number of points per chunk
+    
+    u64    bytes_;                  // bytes read by the last scan
+    double read_time_;              // time of reading by the last scan (s)
+    double wait_time_;              // time of waiting for reads (s)
+
+protected:
+    int   n_;                       // number of data points
+    int   rows_;                    // number of data points per chunk
+    int   fd_;                      // file descriptor of data set
+    int   label_fd_;                // file descriptor of labels (-1: none)
+    u64   N_;                       // total number of coordinates
+    const char *addr_data_;         // address of data set
+    
+    // -------------------------------------------------------------------------
+    void read_bytes(                // read bytes at an offset (exit on error)
+        int   fd,                       // file descriptor
+        u64   offset,                   // offset in file
+        u64   size,                     // number of bytes
+        void  *buf);                    // buffer (return)
+    
+    // -------------------------------------------------------------------------
+    void read_chunk(                // read a chunk of data points
+        int   c,                        // chunk id
+        Chunk<DType> &chunk);           // chunk (return)
+};
+
+// -----------------------------------------------------------------------------
+template<class DType>
+ChunkReader<DType>::ChunkReader(    // constructor
+    int   n,                            // number of data points
+    int   chunk_size,                   // chunk size (MB)
+    const char *addr_data)              // address of data set
+    : bytes_(0UL), read_time_(0.0), wait_time_(0.0), n_(n), label_fd_(-1), 
+    addr_data_(addr_data)
+{
+    fd_ = open(addr_data, O_RDONLY);
+    if (fd_ < 0) { printf("ERROR: cannot open %s\n", addr_data); exit(1); }
+    read_bytes(fd_, (u64) n*sizeof(u64), sizeof(u64), &N_);
+    
+    // the number of points per chunk by the average size of a point
+    double row_bytes = (double) N_*sizeof(DType)/n + sizeof(u64) + sizeof(int);
+    rows_ = (int) std::min((double) n, 
+        std::max(1.0, (double) chunk_size * (1 << 20) / row_bytes));
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+ChunkReader<DType>::~ChunkReader()  // destructor
+{
+    close(fd_);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void ChunkReader<DType>::read_bytes(// read bytes at an offset (exit on error)
+    int   fd,                           // file descriptor
+    u64   offset,                       // offset in file
+    u64   size,                         // number of bytes
+    void  *buf)                         // buffer (return)
+{
+    char *ptr = (char*) buf;
+    while (size > 0) {
+        ssize_t ret = pread(fd, ptr, size, (off_t) offset);
+        if (ret <= 0) {
+            printf("ERROR: cannot read %lu bytes at %lu from %s\n", size, 
+                offset, fd == fd_ ? addr_data_ : "labels");
+            exit(1);
+        }
+        ptr += ret; offset += ret; size -= ret;
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void ChunkReader<DType>::read_chunk(// read a chunk of data points
+    int   c,                            // chunk id
+    Chunk<DType> &chunk)                // chunk (return)
+{
+    double start_time = omp_get_wtime();
+    
+    chunk.start_ = c * rows_;
+    chunk.n_ = std::min(rows_, n_ - chunk.start_);
+    
+    // read the positions, then the coordinates they cover
+    int m = chunk.n_;
+    chunk.pos_.resize(m+1);
+    read_bytes(fd_, (u64) chunk.start_*sizeof(u64), (m+1)*sizeof(u64), 
+        chunk.pos_.data());
+    
+    u64 first = chunk.pos_[0], len = chunk.pos_[m] - first;
+    u64 head  = (u64) (n_+1) * sizeof(u64);
+    chunk.data_.resize(len);
+    read_bytes(fd_, head + first*sizeof(DType), len*sizeof(DType), 
+        chunk.data_.data());
+    for (int i = 0; i <= m; ++i) chunk.pos_[i] -= first;
+    chunk.bytes_ = (m+1)*sizeof(u64) + len*sizeof(DType);
+    
+    // read the spilled labels of this chunk
+    if (label_fd_ >= 0) {
+        chunk.last_.resize(m);
+        read_bytes(label_fd_, (u64) chunk.start_*sizeof(int), m*sizeof(int), 
+            chunk.last_.data());
+        chunk.bytes_ += m*sizeof(int);
+    }
+    else chunk.last_.clear();
+    
+    chunk.read_time_ = omp_get_wtime() - start_time;
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+template<class Func>
+void ChunkReader<DType>::scan(      // read all chunks & process them in order
+    const char *addr_labels,            // spilled labels (nullptr: none)
+    Func  process)                      // process(const Chunk<DType>&)
+{
+    label_fd_ = -1;
+    if (addr_labels != nullptr) {
+        label_fd_ = open(addr_labels, O_RDONLY);
+        if (label_fd_ < 0) {
+            printf("ERROR: cannot open %s\n", addr_labels); exit(1);
+        }
+    }
+    bytes_ = 0UL; read_time_ = 0.0; wait_time_ = 0.0;
+    
+    // chunk c+1 is read into the other buffer while chunk c is processed
+    int n_chunks = (n_ + rows_ - 1) / rows_;
+    Chunk<DType> bufs[2];
+    std::thread reader(&ChunkReader<DType>::read_chunk, this, 0, 
+        std::ref(bufs[0]));
+    for (int c = 0; c < n_chunks; ++c) {
+        double start_time = omp_get_wtime();
+        reader.join();
+        wait_time_ += omp_get_wtime() - start_time;
+        
+        Chunk<DType> &chunk = bufs[c & 1];
+        bytes_ += chunk.bytes_; read_time_ += chunk.read_time_;
+        if (c+1 < n_chunks) {
+            reader = std::thread(&ChunkReader<DType>::read_chunk, this, c+1, 
+                std::ref(bufs[(c+1) & 1]));
+        }
+        process((const Chunk<DType>&) chunk);
+    }
+    if (label_fd_ >= 0) { close(label_fd_); label_fd_ = -1; }
+}
+
+// -----------------------------------------------------------------------------
+//  StreamKFreqItems: out-of-core k-freqitems, which keeps only the seeds and
+//  the item counters in memory; each iteration scans the data file once by
+//  the fused assignment & per-cluster counting, and spills labels to disk
+// -----------------------------------------------------------------------------
+template<class DType>
+class StreamKFreqItems {
+public:
+    StreamKFreqItems(               // constructor
+        int   n,                        // number of data points
+        int   max_iter,                 // maximum iteration
+        float change_ratio,             // stop if changed labels <= ratio * n
+        float mse_tol,                  // stop if mse delta <= tol*mse (0: off)
+        int   bitmap_len,               // min seed length for bitmap (0: none)
+        int   chunk_size,               // chunk size (MB)
+        float alpha,                    // global alpha
+        const char *folder,             // output folder
+        const char *addr_data);         // address of data set
+    
+    // -------------------------------------------------------------------------
+    ~StreamKFreqItems();            // destructor
+    
+    // -------------------------------------------------------------------------
+    void display();                 // display parameters
+    
+    // -------------------------------------------------------------------------
+    int clustering(                 // k-freqitems clustering
+        int k);                         // #clusters (specified by users)
+
+protected:
+    int   n_;                       // number of data points
+    int   max_iter_;                // maximum iteration
+    float change_ratio_;            // stop if changed labels <= ratio * n
+    float mse_tol_;                 // stop if mse delta <= tol*mse (0: off)
+    int   bitmap_len_;              // min seed length for bitmap (0: none)
+    int   chunk_size_;              // chunk size (MB)
+    float alpha_;                   // global \alpha
+    char  folder_[200];             // output folder
+    
+    int   avg_d_;                   // average dimension of sparse data
+    int   max_item_;                // max item id of sparse data
+    ChunkReader<DType> reader_;     // chunk reader of data set
+    
+    // -------------------------------------------------------------------------
+    void sample_seeding(            // seeding on a reservoir sample
+        int   k,                        // number of seeds
+        std::vector<DType> &seedset,    // seed set (return)
+        std::vector<u64> &seedpos);     // seed position (return)
+    
+    // -------------------------------------------------------------------------
+    void label_file(                // get the name of a spilled label file
+        int   k,                        // #clusters (specified by users)
+        int   id,                       // file id
+        char  *fname);                  // file name (return)
+};
+
+// -----------------------------------------------------------------------------
+template<class DType>
+StreamKFreqItems<DType>::StreamKFreqItems(// constructor
+    int   n,                            // number of data points
+    int   max_iter,                     // maximum iteration
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol*mse (0: off)
+    int   bitmap_len,                   // min seed length for bitmap (0: none)
+    int   chunk_size,                   // chunk size (MB)
+    float alpha,                        // global alpha
+    const char *folder,                 // output folder
+    const char *addr_data)              // address of data set
+    : n_(n), max_iter_(max_iter), change_ratio_(change_ratio), 
+    mse_tol_(mse_tol), bitmap_len_(bitmap_len), chunk_size_(chunk_size), 
+    alpha_(alpha), max_item_(0), reader_(n, chunk_size, addr_data)
+{
+    strncpy(folder_, folder, sizeof(folder_)); // init folder_
+    avg_d_ = (int) ceil((double) reader_.num_coords() / (double) n);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+StreamKFreqItems<DType>::~StreamKFreqItems() // destructor
+{
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void StreamKFreqItems<DType>::display() // display parameters
+{
+    printf("The parameters of StreamKFreqItems:\n");
+    printf("n        = %d\n",   n_);
+    printf("avg_d    = %d\n",   avg_d_);
+    printf("max_iter = %d\n",   max_iter_);
+    printf("changed  = %g\n",   change_ratio_);
+    printf("mse_tol  = %g\n",   mse_tol_);
+    printf("bitmap   = %d\n",   bitmap_len_);
+    printf("chunk    = %d MB (%d points)\n", chunk_size_, reader_.chunk_rows());
+    printf("alpha    = %g\n",   alpha_);
+    printf("folder   = %s\n\n", folder_);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void StreamKFreqItems<DType>::label_file(// get the name of a label file
+    int   k,                            // #clusters (specified by users)
+    int   id,                           // file id
+    char  *fname)                       // file name (return)
+{
+    sprintf(fname, "%s%d_stream_%d.labels", folder_, k, id);
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+void StreamKFreqItems<DType>::sample_seeding(// seeding on a reservoir sample
+    int   k,                            // number of seeds
+    std::vector<DType> &seedset,        // seed set (return)
+    std::vector<u64> &seedpos)          // seed position (return)
+{
+    // keep the m points with the smallest hash keys, i.e., a uniform sample
+    // without replacement that does not depend on the chunk size; the pool
+    // holds at most 2m candidates between two compactions
+    int m = (int) std::min((u64) n_, (u64) STREAM_SAMPLE * k);
+    std::vector<std::pair<double,int> > keys; // (key, index in pool)
+    std::vector<DType> pool_set; std::vector<u64> pool_pos(1, 0UL);
+    double threshold = 1.0; // the m-th smallest key so far
+    int max_item = 0;
+    
+    auto compact = [&]() {
+        std::nth_element(keys.begin(), keys.begin()+(m-1), keys.end());
+        keys.resize(m); threshold = keys[m-1].first;
+        
+        std::vector<int> ids(m);
+        for (int i = 0; i < m; ++i) {
+            ids[i] = keys[i].second; keys[i].second = i;
+        }
+        std::vector<DType> set; std::vector<u64> pos;
+        gather_data<DType>(m, ids.data(), pool_set.data(), pool_pos.data(), 
+            set, pos);
+        pool_set.swap(set); pool_pos.swap(pos);
+    };
+    reader_.scan(nullptr, [&](const Chunk<DType> &chunk) {
+        const DType *dataset = chunk.data_.data();
+        const u64   *datapos = chunk.pos_.data();
+        
+#pragma omp parallel for reduction(max:max_item)
+        for (u64 j = 0; j < datapos[chunk.n_]; ++j) {
+            max_item = std::max(max_item, (int) dataset[j]);
+        }
+        for (int i = 0; i < chunk.n_; ++i) {
+            double key = hash_uniform(RANDOM_SEED, chunk.start_+i);
+            if (key >= threshold) continue;
+            
+            keys.push_back(std::make_pair(key, (int) pool_pos.size()-1));
+            pool_set.insert(pool_set.end(), dataset+datapos[i], 
+                dataset+datapos[i+1]);
+            pool_pos.push_back(pool_set.size());
+            if ((int) keys.size() >= 2*m) compact();
+        }
+    });
+    if ((int) keys.size() > m) compact();
+    m = (int) keys.size();
+    max_item_ = max_item;
+    
+    // k-means++ seeding on the sample
+    std::vector<int> distinct_ids(k), weights(m, 1);
+    kmeanspp_seeding<DType>(m, k, SparseRows<DType>(m, pool_set.data(), 
+        pool_pos.data()), weights.data(), distinct_ids.data(), seedset, 
+        seedpos);
+        
+#ifdef DEBUG_INFO
+    printf("Stream: %d points per chunk, %d sampled points, io=%.2lf MB/s\n\n", 
+        reader_.chunk_rows(), m, reader_.bytes_ / 1048576.0 / 
+        std::max(reader_.read_time_, 1e-9));
+#endif
+}
+
+// -----------------------------------------------------------------------------
+template<class DType>
+int StreamKFreqItems<DType>::clustering(// k-freqitems clustering
+    int k)                              // #clusters (specified by users)
+{
+    double start_wc_time = omp_get_wtime();
+    srand(RANDOM_SEED); // fix a random seed
+    
+    // -------------------------------------------------------------------------
+    //  k-means++ seeding on a reservoir sample of the data
+    // -------------------------------------------------------------------------
+    std::vector<DType> seedset, best_seedset;
+    std::vector<u64> seedpos, best_seedpos, bitset, bitpos;
+    sample_seeding(k, seedset, seedpos);
+    
+    g_init_wc_time = omp_get_wtime() - start_wc_time;
+#ifdef DEBUG_INFO
+    printf("k-FreqItems++ Seeding: k=%d, init_time=%.2lf seconds\n\n", k, 
+        g_init_wc_time);
+#endif
+    
+    // -------------------------------------------------------------------------
+    //  assignment-update iterations, one scan of the data file each
+    // -------------------------------------------------------------------------
+    // the labels of an iteration are spilled in the numbering of the seeds
+    // they were assigned to, and the map new_id of that iteration gives their
+    // final numbering; three files are rotated, so the labels of the last
+    // and the best iterations are kept
+    int n_threads = omp_get_max_threads();
+    int K = k, iter = 0;
+    int last_file = -1, best_file = -1;
+    std::vector<int> last_new_id, best_new_id;
+    std::vector<f64> busy;
+    char fname[200], last_fname[200];
+    f32 mae = -1.0f, mse = -1.0f, last_mse = MAX_FLOAT;
+    
+    g_mse = MAX_FLOAT;
+    while (iter < max_iter_) {
+        ++iter;
+        double local_start_wtime = omp_get_wtime();
+        
+        int cur_file = 0;
+        while (cur_file == last_file || cur_file == best_file) ++cur_file;
+        label_file(k, cur_file, fname);
+        FILE *fp = fopen(fname, "wb");
+        if (!fp) { printf("Could not open %s\n", fname); exit(1); }
+        if (last_file >= 0) label_file(k, last_file, last_fname);
+        
+        const u64 *bitset_ptr = bitpos.empty() ? nullptr : bitset.data();
+        const u64 *bitpos_ptr = bitpos.empty() ? nullptr : bitpos.data();
+        std::vector<int> sizes((u64) n_threads*K, 0);
+        std::vector<ClusterItemCounter> counters(n_threads);
+        double stat[3] = { 0.0, 0.0, 0.0 }; // sum of w, w*dist, w*dist^2
+        int n_changed = 0;
+        
+        std::vector<int> last, labels;
+        reader_.scan(last_file >= 0 ? last_fname : nullptr, 
+            [&](const Chunk<DType> &chunk) {
+            int m = chunk.n_;
+            last.assign(m, -1); labels.resize(m);
+            if (!chunk.last_.empty()) {
+                for (int i = 0; i < m; ++i) {
+                    last[i] = last_new_id[chunk.last_[i]];
+                }
+            }
+            SparseRows<DType> rows(m, chunk.data_.data(), chunk.pos_.data());
+            n_changed += count_assign_data<DType>(m, K, rows, seedset.data(), 
+                seedpos.data(), bitset_ptr, bitpos_ptr, nullptr, last.data(), 
+                labels.data(), sizes.data(), counters, stat);
+            
+            if (fwrite(labels.data(), sizeof(int), m, fp) != (size_t) m) {
+                printf("ERROR: cannot write %s\n", fname); exit(1);
+            }
+        });
+        fclose(fp);
+        
+        // the stat is of the new labels with the seeds they were assigned to,
+        // so the best state keeps these seeds of the non-empty clusters
+        std::vector<int> new_id(K), old_ids(K);
+        std::vector<DType> new_seedset;
+        std::vector<u64> new_seedpos;
+        int last_K = K;
+        K = counts_to_seeds(last_K, avg_d_, max_item_, alpha_, sizes.data(), 
+            counters, new_id.data(), old_ids.data(), new_seedset, new_seedpos, 
+            busy);
+        mae = (f32) (stat[1] / stat[0]); mse = (f32) (stat[2] / stat[0]);
+        
+        bool best_labels = mse < g_mse;
+        if (best_labels) {
+            keep_assigned_seeds<DType>(K, old_ids.data(), seedset.data(), 
+                seedpos.data(), best_seedset, best_seedpos);
+            best_file = cur_file; best_new_id = new_id;
+        }
+        last_file = cur_file; last_new_id.swap(new_id);
+        seedset.swap(new_seedset); seedpos.swap(new_seedpos);
+        if (bitmap_len_ > 0) {
+            build_seed_bitmaps(K, bitmap_len_, seedset.data(), seedpos.data(), 
+                bitset, bitpos);
+        }
+        
+        double iter_wc_time = omp_get_wtime() - local_start_wtime;
+        g_tot_wc_time = omp_get_wtime() - start_wc_time;
+        if (best_labels) update_best_stat(K, iter, mae, mse);
+        
+#ifdef DEBUG_INFO
+        printf("iter=%d/%d, k=%d, mse=%f, mae=%f, time=%.2lf, "
+            "total_time=%.2lf\n\n", iter, max_iter_, K, mse, mae, iter_wc_time, 
+            g_tot_wc_time);
+        printf("changed %d/%d labels (%.2f%%)\n\n", n_changed, n_, 
+            100.0 * n_changed / n_);
+        output_busy_info(busy);
+        printf("io: %.2lf MB in %.2lf s (%.2lf MB/s), %.1f%% of the read time "
+            "overlapped with compute\n\n", reader_.bytes_ / 1048576.0, 
+            reader_.read_time_, reader_.bytes_ / 1048576.0 / 
+            std::max(reader_.read_time_, 1e-9), 100.0 * std::max(0.0, 
+            1.0 - reader_.wait_time_ / std::max(reader_.read_time_, 1e-9)));
+        
+        output_iter_info(k, iter, max_iter_, K, mae, mse, iter_wc_time, 
+            iter_wc_time, g_tot_wc_time, -1.0f, folder_);
+#endif
+        if (stop_iteration(n_changed, n_, change_ratio_, mse_tol_, mse, 
+            last_mse)) break;
+    }
+    
+    // -------------------------------------------------------------------------
+    //  renumber the labels of the best iteration & remove spilled labels
+    // -------------------------------------------------------------------------
+    label_file(k, best_file, fname);
+    FILE *ifp = fopen(fname, "rb");
+    sprintf(last_fname, "%s%d_kFreqItems++.labels", folder_, k);
+    FILE *ofp = fopen(last_fname, "wb");
+    if (!ifp || !ofp) { printf("Could not open %s\n", fname); exit(1); }
+    
+    std::vector<int> labels(reader_.chunk_rows());
+    for (int start = 0; start < n_; start += reader_.chunk_rows()) {
+        int m = std::min(reader_.chunk_rows(), n_ - start);
+        if (fread(labels.data(), sizeof(int), m, ifp) != (size_t) m) {
+            printf("ERROR: cannot read %s\n", fname); exit(1);
+        }
+        for (int i = 0; i < m; ++i) labels[i] = best_new_id[labels[i]];
+        fwrite(labels.data(), sizeof(int), m, ofp);
+    }
+    fclose(ifp); fclose(ofp);
+    for (int i = 0; i < 3; ++i) { label_file(k, i, fname); remove(fname); }
+    
+#ifdef DEBUG_INFO
+    output_centers(k, g_k, best_seedset, best_seedpos, folder_);
+#endif
+    g_tot_wc_time  = omp_get_wtime() - start_wc_time;
+    g_iter_wc_time = (g_tot_wc_time  - g_init_wc_time)  / iter;
+    
+    return 0;
+}
+
+} // end namespace clustering
@@ -30,6 +30,34 @@ void create_dir(                    // create dir if the path does not exist
     }
 }
 
+// -----------------------------------------------------------------------------
+void update_best_stat(              // record the stat of the best iteration
+    int   K,                            // actual number of clusters
+    int   iter,                         // which iteration
+    f32   mae,                          // mean absolute error
+    f32   mse)                          // mean square error
+{
+    g_k = K; g_mae = mae; g_mse = mse; g_iter = iter;
+    g_kpp_wc_time = g_tot_wc_time;
+}
+
+// -----------------------------------------------------------------------------
+bool stop_iteration(                // stop rule of k-freqitems iterations
+    int   n_changed,                    // number of changed labels
+    int   n,                            // number of data points
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol*mse (0: off)
+    float mse,                          // mse of this iteration
+    float &last_mse)                    // mse of last iteration (return)
+{
+    // stop if (almost) no label changes or the mse no longer decreases
+    if (n_changed <= change_ratio * n) return true;
+    if (mse_tol > 0 && fabs(last_mse - mse) <= mse_tol * last_mse) return true;
+    
+    last_mse = mse;
+    return false;
+}
+
 // -----------------------------------------------------------------------------
 float uniform(                      // gen a random variable from uniform distr.
     float start,                        // start position
@@ -39,4 +67,15 @@ float uniform(                      // gen a random variable from uniform distr.
     return start + ((end-start)*rand() / (float) RAND_MAX);
 }
 
+// -----------------------------------------------------------------------------
+double uniform(                     // gen a random variable from uniform distr.
+    double start,                       // start position
+    double end)                         // end position (62 random bits)
+{
+    assert(start < end);
+    double range = (double) RAND_MAX + 1.0;
+    double r = ((double) rand() * range + rand()) / (range * range); // [0,1)
+    return start + (end-start) * r;
+}
+
 } // end namespace clustering
@@ -15,12 +15,15 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <omp.h>
 
 #include "def.h"
+#include "intersect.h"
 
 namespace clustering {
 
@@ -52,12 +55,18 @@ DType* read_sparse_data(            // read sparse data (binary) from disk
     if (!fp) { printf("ERROR: cannot open %s\n", addr_data); exit(1); }
 
     // read the start position of each data
-    fread(datapos, sizeof(u64), n+1, fp);
+    if (fread(datapos, sizeof(u64), n+1, fp) != (size_t) n+1) {
+        printf("ERROR: cannot read %d positions from %s\n", n+1, addr_data);
+        exit(1);
+    }
     
     // read dataset
     u64 N = datapos[n];
     DType *dataset = new DType[N];
-    fread(dataset, sizeof(DType), N, fp);
+    if (fread(dataset, sizeof(DType), N, fp) != N) {
+        printf("ERROR: cannot read %lu coordinates from %s\n", N, addr_data);
+        exit(1);
+    }
     fclose(fp);
     
     double loading_time = omp_get_wtime() - start_time;
@@ -66,36 +75,92 @@ DType* read_sparse_data(            // read sparse data (binary) from disk
     return dataset;
 }
 
+// -----------------------------------------------------------------------------
+template<class DType>
+const DType* map_sparse_data(       // map sparse data (binary) into memory
+    int   n,                            // number of data points
+    const char *addr_data,              // address of data set
+    int   prefault,                     // prefault pages by threads (0: no)
+    const u64 *&datapos,                // data position (return)
+    void  *&addr,                       // start address of mapping (return)
+    u64   &length)                      // length of mapping (return)
+{
+    double start_time = omp_get_wtime();
+    
+    int fd = open(addr_data, O_RDONLY);
+    if (fd < 0) { printf("ERROR: cannot open %s\n", addr_data); exit(1); }
+    
+    struct stat st;
+    u64 head = (u64) (n+1) * sizeof(u64); // bytes of data positions
+    if (fstat(fd, &st) != 0 || (u64) st.st_size < head) {
+        printf("ERROR: cannot read %d positions from %s\n", n+1, addr_data);
+        exit(1);
+    }
+    // a read-only shared mapping, so the runs on the same file share the 
+    // page cache and no heap copy is made; the data follow the positions
+    length = (u64) st.st_size;
+    addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        printf("ERROR: cannot mmap %s\n", addr_data); exit(1);
+    }
+    
+    datapos = (const u64*) addr;
+    u64 N = datapos[n];
+    u64 used = head + N * sizeof(DType); // bytes of the first n data
+    if (used > length) {
+        printf("ERROR: cannot read %lu coordinates from %s\n", N, addr_data);
+        exit(1);
+    }
+    // hint the kernel to read ahead and to use transparent huge pages
+    madvise(addr, used, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    madvise(addr, used, MADV_HUGEPAGE);
+#endif
+    // touch one byte per page by all threads, so that the page faults are 
+    // served in parallel rather than on demand by the first scan
+    if (prefault) {
+        const volatile char *bytes = (const volatile char*) addr;
+        u64 page = (u64) sysconf(_SC_PAGESIZE);
+        u64 n_pages = (used + page - 1) / page;
+        u64 sum = 0UL;
+#pragma omp parallel for reduction(+:sum)
+        for (u64 i = 0; i < n_pages; ++i) sum += bytes[i*page];
+    }
+    
+    double loading_time = omp_get_wtime() - start_time;
+    printf("\nn=%d, N=%lu, time=%.2lf seconds (mmap), path=%s\n\n", n, N, 
+        loading_time, addr_data);
+    return (const DType*) ((const char*) addr + head);
+}
+
 // -----------------------------------------------------------------------------
 template<class DType>
 float jaccard_dist(                 // calc jaccard distance
     int   n_data,                       // number of data dimensions
     int   n_mode,                       // number of mode dimensions
     const DType *data,                  // data point
-    const int   *mode)                  // mode
+    const DType *mode)                  // mode
 {
-    int overlap = 0, i = 0, j = 0; // i for data, j for mode
-    while (i < n_data && j < n_mode) {
-        if (data[i] < mode[j]) ++i;
-        else if (mode[j] < data[i]) ++j;
-        else { ++overlap; ++i; ++j; }
-    }
+    int overlap = intersect_count(n_data, n_mode, data, mode);
     return 1.0f - (float) overlap / (n_data + n_mode - overlap);
 }
 
 // -----------------------------------------------------------------------------
 template<class DType>
-float jaccard_dist2(                // calc jaccard distance
+float bitmap_jaccard_dist(          // calc jaccard distance by seed bitmap
     int   n_data,                       // number of data dimensions
     int   n_seed,                       // number of seed dimensions
+    int   n_words,                      // number of words of seed bitmap
+    int   lo,                           // the smallest item of seed
     const DType *data,                  // data point
-    const DType *seed)                  // seed point
+    const u64   *bits)                  // seed bitmap, bit i for item (lo+i)
 {
-    int overlap = 0, i = 0, j = 0; // i for data, j for seed
-    while (i < n_data && j < n_seed) {
-        if (data[i] < seed[j]) ++i;
-        else if (seed[j] < data[i]) ++j;
-        else { ++overlap; ++i; ++j; }
+    u64 n_bits = (u64) n_words << 6;
+    int overlap = 0;
+    for (int i = 0; i < n_data; ++i) {
+        u64 off = (u64) ((int) data[i] - lo); // wraps around if data[i] < lo
+        if (off < n_bits) overlap += (bits[off>>6] >> (off&63)) & 1UL;
     }
     return 1.0f - (float) overlap / (n_data + n_seed - overlap);
 }
@@ -109,41 +174,49 @@ inline int get_length(// get the length of pos
 }
 
 // -----------------------------------------------------------------------------
-template<class DType>
-int distinct_coord_and_freq(        // get max freq, distinct coords & freqs
-    u64   total_num,                    // total number of coordinates
-    DType *arr,                         // store all coordinates (allow modify)
-    DType *coord,                       // distinct coordinates (return)
-    int   *freq,                        // frequency (return)
-    int   &cnt)                         // counter for #distinct (return)
-{
-    // sort all coordinates in ascending order
-    std::sort(arr, arr + total_num);
-    
-    // get the distinct coordinates and their frequencies (sequential)
-    int max_freq = 0, last = 0, this_freq = -1;
-    cnt = 0;
-    for (size_t i = 1; i < total_num; ++i) {
-        if (arr[i] != arr[i-1]) {
-            this_freq = i - last;
-            coord[cnt] = arr[i-1]; freq[cnt] = this_freq;
-            if (this_freq > max_freq) max_freq = this_freq;
-            
-            last = i; ++cnt;
-        }
-    }
-    // deal with the last element of arr
-    this_freq = total_num - last;
-    coord[cnt] = arr[total_num-1]; freq[cnt] = this_freq;
-    if (this_freq > max_freq) max_freq = this_freq;
-    ++cnt;
-    
-    return max_freq;
-}
+void update_best_stat(              // record the stat of the best iteration
+    int   K,                            // actual number of clusters
+    int   iter,                         // which iteration
+    f32   mae,                          // mean absolute error
+    f32   mse);                         // mean square error
+
+// -----------------------------------------------------------------------------
+bool stop_iteration(                // stop rule of k-freqitems iterations
+    int   n_changed,                    // number of changed labels
+    int   n,                            // number of data points
+    float change_ratio,                 // stop if changed labels <= ratio * n
+    float mse_tol,                      // stop if mse delta <= tol*mse (0: off)
+    float mse,                          // mse of this iteration
+    float &last_mse);                   // mse of last iteration (return)
 
 // -----------------------------------------------------------------------------
 float uniform(                      // gen a random variable from uniform distr.
     float start,                        // start position
     float end);                         // end position
 
+// -----------------------------------------------------------------------------
+double uniform(                     // gen a random variable from uniform distr.
+    double start,                       // start position
+    double end);                        // end position (62 random bits)
+
+// -----------------------------------------------------------------------------
+inline u64 mix64(                   // splitmix64 finalizer (bijective hash)
+    u64   x)                            // input key
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+    return x ^ (x >> 31);
+}
+
+// -----------------------------------------------------------------------------
+inline double hash_uniform(         // gen a uniform [0,1) variable by hashing
+    u64   stream,                       // stream id (e.g., seed and round)
+    u64   id)                           // data id
+{
+    // each (stream, id) has its own random variable, so the result does not 
+    // depend on the number of threads or the order of evaluation
+    u64 x = mix64(stream * 0x9E3779B97F4A7C15UL + id);
+    return (double) (x >> 11) * (1.0 / 9007199254740992.0); // 2^-53
+}
+
 } // end namespace clustering